@@ -0,0 +1,73 @@
+#include "batch.h"
+#include <fstream>
+#include <thread>
+#include <atomic>
+
+using namespace std;
+
+// run commands[first..last) on up to `threads` threads, results[i] gets the output of commands[i]
+static void runQueries(CommandTarget& target, MyVector<Command>& commands, int first, int last, unsigned int threads, MyVector<string>& results) {
+    int count = last - first;
+    if (threads > (unsigned int)count) threads = count;
+    if (threads <= 1) {
+        for (int i = first; i < last; i++) results[i] = runCommand(target, commands[i]);
+        return;
+    }
+
+    atomic<int> next(first); // threads take the next command as they finish one
+    MyVector<thread*> workers;
+    for (unsigned int t = 0; t < threads; t++) {
+        workers.push_back(new thread([&target, &commands, &results, &next, last]() {
+            for (int i = next++; i < last; i = next++) {
+                results[i] = runCommand(target, commands[i]);
+            }
+        }));
+    }
+    for (int t = 0; t < workers.size(); t++) {
+        workers[t]->join();
+        delete workers[t];
+    }
+}
+
+int runBatch(CommandTarget& target, const string& path, ostream& out, unsigned int threads) {
+    ifstream file(path);
+    if (!file.is_open()) {
+        cerr << "error: unable to open command file: " << path << endl;
+        return -1;
+    }
+    if (threads == 0) threads = thread::hardware_concurrency();
+
+    // parse everything up front
+    MyVector<Command> commands;
+    string line;
+    while (getline(file, line)) {
+        if (!line.empty() && line[line.length() - 1] == '\r') line.erase(line.length() - 1);
+        if (line.empty()) continue;
+        Command command = parseCommand(line);
+        if (command.name == "exit") break;
+        commands.push_back(command);
+    }
+    file.close();
+
+    MyVector<string> results;
+    for (int i = 0; i < commands.size(); i++) results.push_back("");
+
+    int i = 0;
+    while (i < commands.size()) {
+        if (!isReadOnly(commands[i])) {
+            results[i] = runCommand(target, commands[i]); // changes run alone, in order
+            out << results[i];
+            i++;
+            continue;
+        }
+
+        // a run of queries sees the same catalog, whatever order they run in
+        int last = i;
+        while (last < commands.size() && isReadOnly(commands[last])) last++;
+        runQueries(target, commands, i, last, threads, results);
+        for (; i < last; i++) out << results[i];
+    }
+
+    out.flush();
+    return commands.size();
+}
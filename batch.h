@@ -0,0 +1,24 @@
+//============================================================================
+// Name         : batch.h
+// Author       :
+// Version      : 1.0
+// Date Created :
+// Date Modified:
+// Description  : Non-interactive execution of a file of commands
+//============================================================================
+#ifndef _BATCH_H
+#define _BATCH_H
+#include<string>
+#include<iostream>
+#include "commands.h"
+using namespace std;
+
+//Run every command of a file, one per line as typed at the prompt, with the
+//commands that normally prompt taking their answers inline (see
+//executeCommand). The whole file is parsed before the first command runs and
+//stops at "exit". Consecutive read-only commands run side by side on up to
+//`threads` threads (0 = one per core); the output of every command is
+//collected on its own and written to `out` in file order, without a flush per
+//line. Returns the number of commands run, -1 if the file can not be read.
+int runBatch(CommandTarget& target, const string& path, ostream& out, unsigned int threads = 0);
+#endif
@@ -0,0 +1,64 @@
+#include "bloom.h"
+#include <cmath>
+#include <cstring>
+
+using namespace std;
+
+BloomFilter::BloomFilter() : bits(nullptr), bitCount(0), keys(0), capacity(0) {
+    reset(BLOOM_MIN_KEYS);
+}
+
+BloomFilter::~BloomFilter() {
+    delete[] bits;
+}
+
+void BloomFilter::reset(unsigned long expectedKeys) {
+    if (expectedKeys < BLOOM_MIN_KEYS) expectedKeys = BLOOM_MIN_KEYS;
+
+    uint64_t words = (expectedKeys * BLOOM_BITS_PER_KEY + 63) / 64;
+    delete[] bits;
+    bits = new uint64_t[words];
+    memset(bits, 0, words * sizeof(uint64_t));
+    bitCount = words * 64;
+    keys = 0;
+    capacity = expectedKeys;
+}
+
+// i-th probe position: h1 + i*h2, with h2 odd so the probes never collapse
+static inline uint64_t probe(const KeyHash& key, int i, uint64_t bitCount) {
+    uint64_t h1 = key.hash;
+    uint64_t h2 = ((h1 >> 32) | (h1 << 32)) * 0x9E3779B97F4A7C15ULL | 1;
+    return (h1 + i * h2) % bitCount;
+}
+
+void BloomFilter::insert(const KeyHash& key) {
+    for (int i = 0; i < BLOOM_HASHES; i++) {
+        uint64_t bit = probe(key, i, bitCount);
+        bits[bit / 64] |= (uint64_t)1 << (bit % 64);
+    }
+    keys++;
+}
+
+bool BloomFilter::mayContain(const KeyHash& key) const {
+    for (int i = 0; i < BLOOM_HASHES; i++) {
+        uint64_t bit = probe(key, i, bitCount);
+        if ((bits[bit / 64] & ((uint64_t)1 << (bit % 64))) == 0) return false;
+    }
+    return true;
+}
+
+bool BloomFilter::full() const {
+    return keys > capacity;
+}
+
+unsigned long BloomFilter::size() const {
+    return keys;
+}
+
+double BloomFilter::estimatedFalsePositiveRate() const {
+    uint64_t set = 0;
+    for (uint64_t i = 0; i < bitCount / 64; i++) {
+        set += __builtin_popcountll(bits[i]);
+    }
+    return pow((double)set / bitCount, BLOOM_HASHES);
+}
@@ -0,0 +1,42 @@
+//============================================================================
+// Name         : bloom.h
+// Author       :
+// Version      : 1.0
+// Date Created :
+// Date Modified:
+// Description  : Bloom filter over book keys for fast negative lookups
+//============================================================================
+#ifndef _BLOOM_H
+#define _BLOOM_H
+#include<stdint.h>
+#include "keyhash.h"
+
+#define BLOOM_BITS_PER_KEY 10	//~1% false positives at full capacity
+#define BLOOM_HASHES 7			//probes per key
+#define BLOOM_MIN_KEYS 1024		//smallest capacity a filter is sized for
+
+//Answers "definitely not present" or "maybe present" for a key. Keys are the
+//precomputed KeyHash of titles and isbns, the probe positions are derived
+//from that one hash by double hashing. Bits can not be cleared, so the owner
+//rebuilds the filter after enough deletions or when it outgrows its capacity.
+class BloomFilter
+{
+	private:
+		uint64_t* bits;
+		uint64_t bitCount;
+		unsigned long keys;		//keys inserted since the last reset
+		unsigned long capacity;	//keys the filter was sized for
+
+		BloomFilter(const BloomFilter&);	//not copyable
+		BloomFilter& operator=(const BloomFilter&);
+	public:
+		BloomFilter();
+		~BloomFilter();
+		void reset(unsigned long expectedKeys);		//clear the filter and size it for a number of keys
+		void insert(const KeyHash& key);
+		bool mayContain(const KeyHash& key) const;	//false means the key was never inserted
+		bool full() const;							//true once more keys than the capacity were inserted
+		unsigned long size() const;					//keys inserted
+		double estimatedFalsePositiveRate() const;	//from the fraction of bits set
+};
+#endif
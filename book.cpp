@@ -1,27 +1,26 @@
 #include "book.h"
+#include "snapshot.h"
 
 // constructor
 Book::Book(string title, string author, string isbn, int publication_year, int total_copies, int available_copies)
     : title(title), author(author), isbn(isbn),
     publication_year(publication_year),
     total_copies(total_copies),
-    available_copies(available_copies) {
-    currentBorrowers = MyVector<Borrower*>();
-    allBorrowers = MyVector<Borrower*>();
+    available_copies(available_copies), id(0), category(0xFFFFFFFFu), nextBook(0xFFFFFFFFu), borrowCount(0), borrowerCount(0) {
+    rehash();
 }
 
-void Book::display() { // display book information
-    cout << "----------------------------------------------------\n";
-    cout << "Title:               " << title << endl;
-    cout << "Author(s):           " << author << endl;
-    cout << "ISBN:                " << isbn << endl;
-    cout << "Year:                " << publication_year << endl;
-    cout << "Total copies:        " << total_copies << endl;
-    cout << "Available copies:    " << available_copies - currentBorrowers.size() << endl;
-    cout << "----------------------------------------------------\n";
+// refresh the precomputed key hashes
+void Book::rehash() {
+    titleKey = hashKey(title);
+    isbnKey = hashKey(isbn);
+}
+
+void Book::display(ostream& out) { // display book information
+    BookRow(*this).display(out); // same layout as the rows of a snapshot
 }
 
 // overloaded == operator to compare books by isbn
 bool Book::operator==(const Book& b) const {
-    return this->isbn == b.isbn;
+    return sameKey(isbn, isbnKey, b.isbn, b.isbnKey);
 }
\ No newline at end of file
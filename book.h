@@ -9,8 +9,12 @@
 #ifndef _BOOK_H
 #define _BOOK_H
 #include<string>
+#include<atomic>
 #include "myvector.h"
+#include "keyhash.h"
+#include "borrowerset.h"
 class Borrower;
+class Node;
 class Book
 {
 	private:
@@ -19,14 +23,21 @@ class Book
 		std::string isbn;
 		int publication_year;
 		int total_copies;
-		int available_copies;
-		MyVector<Borrower*> currentBorrowers;	//current borrowers of the book
-		MyVector<Borrower*> allBorrowers;   //history of all borrowers of the book
+		std::atomic<int> available_copies;	//changed under the book's stripe lock, read without it
+		BorrowerSet currentBorrowers;	//current borrowers of the book (the history is in LCMS's circulation log)
+		unsigned int id;	//position in the catalog's book table, set when the book is added
+		unsigned int category;	//id of the category node holding the book (0xFFFFFFFF until the book is added)
+		unsigned int nextBook;	//id of the next book of the same category (0xFFFFFFFF for the last one)
+		unsigned int borrowCount;	//number of times the book has been borrowed
+		unsigned int borrowerCount;	//number of distinct borrowers the book has had
+		KeyHash titleKey;	//hash of title, refreshed by rehash()
+		KeyHash isbnKey;	//hash of isbn, refreshed by rehash()
 
 	public:
 		Book(std::string title, std::string author, std::string isbn, int publication_year,int total_copies, int available_copies);
-		void display(); // display details of a book (see output of command findbook)
+		void display(ostream& out = cout); // display details of a book (see output of command findbook)
 		bool operator==(const Book& b) const;
+		void rehash(); // recompute titleKey/isbnKey, call after editing title or isbn
 
 
 		bool operator ==(Book* book); // operator overloaded to compare boojs
@@ -35,5 +46,7 @@ class Book
 		friend class Node;
 		friend class LCMS;
 		friend class Borrower;
+		friend struct BookRow;
+		friend class ChangeJournal;
 };
 #endif
\ No newline at end of file
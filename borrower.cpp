@@ -2,7 +2,7 @@
 
 using namespace std;
 // paramterized constructor 
-Borrower::Borrower(string Name, string ID) : name(Name), id(ID), books_borrowed() {}
+Borrower::Borrower(string Name, string ID) : name(Name), id(ID), books_borrowed(), idKey(hashKey(ID)), number(0) {}
 
 
 void Borrower::listBooks() {
@@ -10,6 +10,8 @@ class Borrower
 		string name;
 		string id;
 		MyVector<Book*> books_borrowed;
+		KeyHash idKey;	//hash of id
+		unsigned int number;	//position in the catalog's borrower list, used by the circulation log
 	public:
 		Borrower(string name, string id);
 		friend class LCMS;
@@ -0,0 +1,91 @@
+#include "borrowerset.h"
+
+using namespace std;
+
+BorrowerSet::BorrowerSet() : slots(), live(0), index(nullptr) {}
+
+BorrowerSet::~BorrowerSet() {
+    delete index;
+}
+
+int BorrowerSet::find(Borrower* borrower) const {
+    if (index != nullptr) {
+        unordered_map<Borrower*, int>::const_iterator it = index->find(borrower);
+        return it == index->end() ? -1 : it->second;
+    }
+
+    // small set: a short scan is cheaper than hashing
+    for (int i = 0; i < slots.size(); i++) {
+        if (slots[i] == borrower) return i;
+    }
+    return -1;
+}
+
+void BorrowerSet::buildIndex() {
+    index = new unordered_map<Borrower*, int>();
+    index->reserve(2 * live);
+    for (int i = 0; i < slots.size(); i++) {
+        if (slots[i] != nullptr) (*index)[slots[i]] = i;
+    }
+}
+
+void BorrowerSet::compact() {
+    MyVector<Borrower*> members;
+    for (int i = 0; i < slots.size(); i++) {
+        if (slots[i] != nullptr) members.push_back(slots[i]); // keeps insertion order
+    }
+    slots = members;
+
+    delete index;
+    index = nullptr;
+    if (live > BORROWER_SET_INLINE) buildIndex();
+}
+
+bool BorrowerSet::contains(Borrower* borrower) const {
+    return find(borrower) != -1;
+}
+
+bool BorrowerSet::insert(Borrower* borrower) {
+    if (borrower == nullptr || find(borrower) != -1) return false;
+
+    slots.push_back(borrower);
+    live++;
+    if (index != nullptr) {
+        (*index)[borrower] = slots.size() - 1;
+    }
+    else if (live > BORROWER_SET_INLINE) {
+        buildIndex(); // the set outgrew the inline list
+    }
+    return true;
+}
+
+bool BorrowerSet::remove(Borrower* borrower) {
+    int slot = find(borrower);
+    if (slot == -1) return false;
+
+    live--;
+    if (index == nullptr) {
+        slots.erase(slot); // small set: shifting a few pointers is fine
+        return true;
+    }
+
+    // large set: leave a hole instead of shifting, compact once holes dominate
+    slots[slot] = nullptr;
+    index->erase(borrower);
+    if (slots.size() - live > live && slots.size() > 2 * BORROWER_SET_INLINE) {
+        compact();
+    }
+    return true;
+}
+
+int BorrowerSet::size() const {
+    return live;
+}
+
+int BorrowerSet::capacity() const {
+    return slots.size();
+}
+
+Borrower* BorrowerSet::at(int slot) const {
+    return slots[slot];
+}
@@ -0,0 +1,46 @@
+//============================================================================
+// Name         : borrowerset.h
+// Author       :
+// Version      : 1.0
+// Date Created :
+// Date Modified:
+// Description  : Set of borrowers of a book with O(1) membership checks
+//============================================================================
+#ifndef _BORROWERSET_H
+#define _BORROWERSET_H
+#include<unordered_map>
+#include<atomic>
+#include "myvector.h"
+
+#define BORROWER_SET_INLINE 16	//up to this many members the set is a plain list
+
+class Borrower;
+
+//Members are kept in insertion order. Small sets are scanned linearly; once a
+//set grows past BORROWER_SET_INLINE a hash index from borrower to slot is
+//built, and removals leave an empty slot (nullptr) that is compacted away
+//later, so contains/insert/remove stay O(1) whatever the history length.
+class BorrowerSet
+{
+	private:
+		MyVector<Borrower*> slots;						//members in insertion order, nullptr for removed members
+		std::atomic<int> live;							//number of members, size() may be read without the book's lock
+		std::unordered_map<Borrower*, int>* index;		//slot of every member, nullptr while the set is small
+
+		int find(Borrower* borrower) const;				//slot of a member or -1
+		void buildIndex();								//switch to the indexed representation
+		void compact();									//squeeze out empty slots and rebuild the index
+
+		BorrowerSet(const BorrowerSet&);				//not copyable
+		BorrowerSet& operator=(const BorrowerSet&);
+	public:
+		BorrowerSet();
+		~BorrowerSet();
+		bool contains(Borrower* borrower) const;		//true if the borrower is a member
+		bool insert(Borrower* borrower);				//add a member, false if it was already there
+		bool remove(Borrower* borrower);				//remove a member, false if it was not there
+		int size() const;								//number of members
+		int capacity() const;							//number of slots, use with at()
+		Borrower* at(int slot) const;					//member stored in a slot, nullptr for an empty slot
+};
+#endif
@@ -0,0 +1,68 @@
+#include "circulation.h"
+#include <atomic>
+
+using namespace std;
+
+static atomic<uint32_t> nextSequence(0); // shared by the logs of all shards
+
+CirculationLog::CirculationLog() : segments(), count(0) {}
+
+CirculationLog::~CirculationLog() {
+    for (int i = 0; i < segments.size(); i++) {
+        delete[] segments[i];
+    }
+}
+
+uint32_t CirculationLog::head(const MyVector<uint32_t>& heads, uint32_t id) {
+    return id < (uint32_t)heads.size() ? heads[id] : NO_RECORD;
+}
+
+void CirculationLog::setHead(MyVector<uint32_t>& heads, uint32_t id, uint32_t record) {
+    while ((uint32_t)heads.size() <= id) {
+        heads.push_back(NO_RECORD); // ids are dense, so this grows by one most of the time
+    }
+    heads[id] = record;
+}
+
+uint32_t CirculationLog::append(uint32_t bookId, uint32_t borrowerId, CirculationEvent event, int64_t timestamp) {
+    if (count % CIRCULATION_SEGMENT == 0) {
+        segments.push_back(new CirculationRecord[CIRCULATION_SEGMENT]); // start a new segment
+    }
+
+    uint32_t number = count++;
+    CirculationRecord& record = segments[number / CIRCULATION_SEGMENT][number % CIRCULATION_SEGMENT];
+    record.bookId = bookId;
+    record.borrowerId = borrowerId;
+    record.prevForBook = head(bookHead, bookId);
+    record.prevForBorrower = head(borrowerHead, borrowerId);
+    record.timestamp = timestamp;
+    record.event = event;
+    record.sequence = nextSequence++;
+
+    setHead(bookHead, bookId, number);
+    setHead(borrowerHead, borrowerId, number);
+    if (event == EVENT_BORROW) {
+        pairs.insert(((uint64_t)bookId << 32) | borrowerId);
+    }
+    return number;
+}
+
+const CirculationRecord& CirculationLog::at(uint32_t record) const {
+    return segments[record / CIRCULATION_SEGMENT][record % CIRCULATION_SEGMENT];
+}
+
+uint32_t CirculationLog::size() const {
+    return count;
+}
+
+uint32_t CirculationLog::latestForBook(uint32_t bookId) const {
+    return head(bookHead, bookId);
+}
+
+uint32_t CirculationLog::latestForBorrower(uint32_t borrowerId) const {
+    return head(borrowerHead, borrowerId);
+}
+
+bool CirculationLog::hasBorrowed(uint32_t bookId, uint32_t borrowerId) const {
+    return pairs.count(((uint64_t)bookId << 32) | borrowerId) != 0;
+}
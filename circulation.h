@@ -0,0 +1,64 @@
+//============================================================================
+// Name         : circulation.h
+// Author       :
+// Version      : 1.0
+// Date Created :
+// Date Modified:
+// Description  : Append-only circulation log of borrow/return events
+//============================================================================
+#ifndef _CIRCULATION_H
+#define _CIRCULATION_H
+#include<stdint.h>
+#include<unordered_set>
+#include "myvector.h"
+
+#define CIRCULATION_SEGMENT 4096	//records per segment of the log
+#define NO_RECORD 0xFFFFFFFFu		//end of a per-book / per-borrower chain
+
+enum CirculationEvent
+{
+	EVENT_BORROW = 1,
+	EVENT_RETURN = 2
+};
+
+//One fixed-width (32 byte) log record. Records of the same book and of the
+//same borrower are chained backwards, so the history of one book or one
+//borrower is walked without scanning the whole log.
+struct CirculationRecord
+{
+	uint32_t bookId;			//Book::id
+	uint32_t borrowerId;		//Borrower::number
+	uint32_t prevForBook;		//previous record of the same book or NO_RECORD
+	uint32_t prevForBorrower;	//previous record of the same borrower or NO_RECORD
+	int64_t timestamp;			//seconds since the epoch
+	uint32_t event;				//CirculationEvent
+	uint32_t sequence;			//order of the record among the records of every log in the process (shards merge by it)
+};
+
+//Records are stored in fixed-size segments that are never moved, so growing
+//the log never copies old records.
+class CirculationLog
+{
+	private:
+		MyVector<CirculationRecord*> segments;		//segments of CIRCULATION_SEGMENT records
+		uint32_t count;								//number of records
+		MyVector<uint32_t> bookHead;				//latest record of every book id
+		MyVector<uint32_t> borrowerHead;			//latest record of every borrower number
+		std::unordered_set<uint64_t> pairs;			//(book, borrower) pairs that have ever circulated
+
+		static uint32_t head(const MyVector<uint32_t>& heads, uint32_t id);
+		static void setHead(MyVector<uint32_t>& heads, uint32_t id, uint32_t record);
+
+		CirculationLog(const CirculationLog&);		//not copyable
+		CirculationLog& operator=(const CirculationLog&);
+	public:
+		CirculationLog();
+		~CirculationLog();
+		uint32_t append(uint32_t bookId, uint32_t borrowerId, CirculationEvent event, int64_t timestamp); //returns the record number
+		const CirculationRecord& at(uint32_t record) const;		//record by number
+		uint32_t size() const;									//number of records
+		uint32_t latestForBook(uint32_t bookId) const;			//newest record of a book or NO_RECORD
+		uint32_t latestForBorrower(uint32_t borrowerId) const;	//newest record of a borrower or NO_RECORD
+		bool hasBorrowed(uint32_t bookId, uint32_t borrowerId) const; //true if the borrower has ever borrowed the book
+};
+#endif
@@ -0,0 +1,215 @@
+#include "commands.h"
+#include "mapped.h"
+#include "output.h"
+#include <sstream>
+
+using namespace std;
+
+Command parseCommand(const string& line) {
+    Command command;
+    stringstream sstr(line);
+    getline(sstr, command.name, ' ');
+    getline(sstr, command.parameter);
+    return command;
+}
+
+MyVector<string> splitArguments(const string& parameter) {
+    MyVector<string> arguments;
+    size_t start = 0;
+    size_t found;
+    while ((found = parameter.find(ARGUMENT_SEPARATOR, start)) != string::npos) {
+        arguments.push_back(parameter.substr(start, found - start));
+        start = found + 1;
+    }
+    arguments.push_back(parameter.substr(start));
+    return arguments;
+}
+
+// true if the parameter has exactly `count` arguments, prints the usage otherwise
+static bool expectArguments(const MyVector<string>& arguments, int count, const char* usage) {
+    if (arguments.size() == count) return true;
+    output() << "usage: " << usage << endl;
+    return false;
+}
+
+// parse a whole-string integer argument, prints an error otherwise
+static bool integerArgument(const string& argument, const char* what, int& value) {
+    istringstream stream(argument);
+    if (stream >> value && stream.eof()) return true;
+    output() << "invalid " << what << "." << endl;
+    return false;
+}
+
+bool sinceArgument(const string& parameter, unsigned long& checkpoint, string& file) {
+    if (parameter.compare(0, 8, "--since ") != 0) return false;
+    istringstream stream(parameter.substr(8));
+    if (stream >> checkpoint && stream.get() == ' ' && getline(stream, file) && !file.empty()) return true;
+    output() << "usage: export --since <checkpoint> <file_name>" << endl;
+    return false;
+}
+
+bool executeCommand(LCMS& lcms, const Command& command) {
+    const string& name = command.name;
+    const string& parameter = command.parameter;
+
+         if (refuseChange(lcms, command))      return true;
+    else if (name == "import")
+    {
+        if (parameter.compare(0, 9, "--follow ") == 0)      lcms.follow(parameter.substr(9));
+        else if (parameter.compare(0, 7, "--stop ") == 0)   lcms.unfollow(parameter.substr(7));
+        else                                                lcms.import(parameter);
+    }
+    else if (name == "reimport")                lcms.reimport(parameter);
+    else if (name == "export")
+    {
+        unsigned long checkpoint;
+        string file;
+        if (parameter.compare(0, 11, "--parallel ") == 0)   lcms.exportData(parameter.substr(11), true);
+        else if (sinceArgument(parameter, checkpoint, file)) lcms.exportChanges(checkpoint, file);
+        else if (parameter.compare(0, 8, "--since ") != 0)  lcms.exportData(parameter);
+    }
+    else if (name == "save")
+    {
+        long written = MappedImage::write(*lcms.catalogSnapshot(""), parameter);
+        if (written >= 0) output() << written << " books have been saved to " << parameter << endl;
+    }
+    else if (name == "list")                    lcms.list(parameter);
+    else if (name == "findAll")                 lcms.findAll(parameter);
+    else if (name == "findBook")                lcms.findBook(parameter);
+    else if (name == "findIsbn")                lcms.findIsbn(parameter);
+    else if (name == "removeBook")              lcms.removeBook(parameter);
+    else if (name == "listCurrentBorrowers")    lcms.listCurrentBorrowers(parameter);
+    else if (name == "listAllBorrowers")        lcms.listAllBorrowers(parameter);
+    else if (name == "listBooks")               lcms.listBooks(parameter);
+    else if (name == "bookHistory")             lcms.bookHistory(parameter);
+    else if (name == "overdue")                 lcms.overdue(parameter);
+    else if (name == "topBooks")                lcms.topBooks(parameter);
+    else if (name == "stats")                   lcms.stats();
+    else if (name == "findCategory")            lcms.findCategory(parameter);
+    else if (name == "addCategory")             lcms.addCategory(parameter);
+    else if (name == "removeCategory")          lcms.removeCategory(parameter);
+    else if (name == "addBook")
+    {
+        MyVector<string> a = splitArguments(parameter);
+        int year, total, available;
+        if (expectArguments(a, 7, "addBook <title>|<author>|<isbn>|<year>|<category>|<total copies>|<available copies>")
+            && integerArgument(a[3], "publication year", year)
+            && integerArgument(a[5], "number of total copies", total)
+            && integerArgument(a[6], "number of available copies", available)) {
+            lcms.addBook(a[0], a[1], a[2], year, a[4], total, available);
+        }
+    }
+    else if (name == "editBook")
+    {
+        MyVector<string> a = splitArguments(parameter);
+        int field;
+        if (expectArguments(a, 3, "editBook <title>|<field 1-6>|<value>")
+            && integerArgument(a[1], "field", field)) {
+            lcms.editBook(a[0], field, a[2]);
+        }
+    }
+    else if (name == "borrowBook" || name == "returnBook")
+    {
+        MyVector<string> a = splitArguments(parameter);
+        if (expectArguments(a, 3, name == "borrowBook" ? "borrowBook <title>|<borrower name>|<borrower id>"
+                                                       : "returnBook <title>|<borrower name>|<borrower id>")) {
+            if (name == "borrowBook")   lcms.borrowBook(a[0], a[1], a[2]);
+            else                        lcms.returnBook(a[0], a[1], a[2]);
+        }
+    }
+    else if (name == "editCategory")
+    {
+        MyVector<string> a = splitArguments(parameter);
+        if (expectArguments(a, 2, "editCategory <category/sub-category/...>|<new name>")) {
+            lcms.renameCategory(a[0], a[1]);
+        }
+    }
+    else return false;
+
+    return true;
+}
+string runCommand(CommandTarget& target, const Command& command) {
+    ostringstream text;
+    OutputRedirect redirect(text); // everything the command prints
+    try {
+        if (command.name == "help") listCommands(output());
+        else if (!command.name.empty() && !target.execute(command)) output() << "Invalid Command!" << endl;
+    }
+    catch (exception& ex) {
+        output() << ex.what() << endl;
+    }
+    return text.str();
+}
+
+bool isReadOnly(const Command& command) {
+    static const char* queries[] = { "list", "findAll", "findBook", "findIsbn", "listCurrentBorrowers",
+        "listAllBorrowers", "listBooks", "bookHistory", "overdue", "topBooks", "stats", "findCategory", "help" };
+    for (size_t i = 0; i < sizeof(queries) / sizeof(queries[0]); i++) {
+        if (command.name == queries[i]) return true;
+    }
+    return false;
+}
+
+bool changesCatalog(const Command& command) {
+    static const char* changes[] = { "import", "reimport", "addBook", "editBook", "removeBook", "borrowBook", "returnBook",
+        "addCategory", "removeCategory", "editCategory" };
+    for (size_t i = 0; i < sizeof(changes) / sizeof(changes[0]); i++) {
+        if (command.name == changes[i]) return true;
+    }
+    return false;
+}
+
+bool refuseChange(LCMS& lcms, const Command& command) {
+    if (!lcms.isReplica() || !changesCatalog(command)) return false;
+    output() << "this catalog is a read-only replica, " << command.name << " must go to the primary." << endl;
+    return true;
+}
+
+//======================================================================================
+void listCommands(ostream& out)
+{
+	out<<" ===================================================================================="<<endl
+        <<" Welcome to the Library Catalog Management System!\n"<<endl
+        <<" List of available Commands:"<<endl
+		<<" import <file_name>                          : Read a Book file from a file"<<endl
+		<<" import --follow <file_name>                 : Import a file, then keep importing the rows appended to it"<<endl
+		<<" import --stop <file_name>                   : Stop following a file"<<endl
+		<<" reimport <file_name>                        : Apply a new version of a Book file: insert, update and delete by isbn"<<endl
+		<<" export <file_name>                          : Export Books to a file"<<endl
+		<<" export --parallel <file_name>               : Export Books to a file, formatting rows on all cores"<<endl
+		<<" export --since <checkpoint> <file_name>     : Export the Books inserted, updated or deleted since an earlier export"<<endl
+		<<" save <file_name>                            : Write the catalog as a catalog image (see --catalog)"<<endl
+		<<" compact                                     : Fold the changes into the catalog image (with --catalog)"<<endl
+		<<" findBook <title of the book>                : Search a book in the catalog"<<endl
+		<<" findIsbn <isbn of the book>                 : Search a book in the catalog by isbn"<<endl
+		<<" findAll <category/sub-category/..>          : List all books in a category/sub-category"<<endl
+		<<" addBook                                     : Add a book to the Catalog"<<endl
+		<<" editBook <title of the book>                : Edit a book detail in the catalog"<<endl
+		<<" removeBook <title of the book>              : Remove a book from the Catalog"<<endl
+		<<" borrowBook <title of the book>              : Borrow a book from the Library"<<endl
+		<<" returnBook <title of the book>              : Return a book to the Library"<<endl
+		<<" addBook, editBook, borrowBook, returnBook and editCategory also take their answers inline,"<<endl
+		<<" separated by '|' (this is the only form the server accepts):"<<endl
+		<<"   addBook <title>|<author>|<isbn>|<year>|<category>|<total copies>|<available copies>"<<endl
+		<<"   editBook <title>|<field 1-6>|<value>"<<endl
+		<<"   borrowBook <title>|<borrower name>|<borrower id>"<<endl
+		<<"   returnBook <title>|<borrower name>|<borrower id>"<<endl
+		<<"   editCategory <category/sub-category/...>|<new name>"<<endl
+		<<" listCurrentBorrowers <title of the book>    : Print the list of Borrowers of a book"<<endl
+		<<" listAllBorrowers <title of the book>        : Print the list of all Borrowers that have every borrowed this book"<<endl
+		<<" listBooks <borrower's name, borrower's id>  : Print the list of books borrowed by a borrower"<<endl
+		<<" bookHistory <title of the book>             : Print every borrow/return of a book with its time"<<endl
+		<<" overdue [YYYY-MM-DD]                        : Print the loans that are overdue (as of today or a date)"<<endl
+		<<" topBooks <count> [category/sub-category/..] : Print the most borrowed books of the catalog or a category"<<endl
+		<<" findCategory                                : Find a category in the catalog"<<endl
+		<<" addCategory <category/sub-category/...>     : Add a category/sub-category to the catalog"<<endl
+		<<" removeCategory <category/sub-category/...>  : Remove a category/sub-category from the catalog"<<endl
+		<<" removeCategory --force <category/...>       : Remove a category/sub-category together with its books"<<endl
+		<<" editCategory <category/sub-category/...>    : Edit a category/sub-category"<<endl
+		<<" list                                        : Display all categories from the catalog"<<endl
+		<<" list --stats                                : Display all categories with copies, loans and borrower-titles"<<endl
+		<<" stats                                       : Display cache and lookup filter statistics"<<endl
+		<<" help                                        : Display the list of available commands"<<endl
+		<<" exit                                        : Exit the Program"<<endl
+		<<" ====================================================================================\n"<<endl;	
+}
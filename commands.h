@@ -0,0 +1,84 @@
+//============================================================================
+// Name         : commands.h
+// Author       :
+// Version      : 1.0
+// Date Created :
+// Date Modified:
+// Description  : Parsing and dispatch of command lines with inline arguments
+//============================================================================
+#ifndef _COMMANDS_H
+#define _COMMANDS_H
+#include<string>
+#include "myvector.h"
+#include "lcms.h"
+using namespace std;
+
+#define ARGUMENT_SEPARATOR '|'	//separates the inline arguments of borrowBook, addBook, ...
+
+//one command line, "name parameter"
+struct Command
+{
+	string name;		//first word of the line
+	string parameter;	//rest of the line after the first space
+};
+
+//split a line into command name and parameter, the way the prompt always has
+Command parseCommand(const string& line);
+
+//split an inline parameter "a|b|c" into its arguments
+MyVector<string> splitArguments(const string& parameter);
+
+//Parse "--since <checkpoint> <file>" (export --since). False if the parameter
+//is something else, or (after printing the usage) if it is malformed.
+bool sinceArgument(const string& parameter, unsigned long& checkpoint, string& file);
+
+//Run a command that carries all its arguments on the line; the commands that
+//prompt at the terminal take theirs inline instead:
+//	addBook <title>|<author>|<isbn>|<year>|<category>|<total copies>|<available copies>
+//	editBook <title>|<field 1-6>|<value>
+//	borrowBook <title>|<borrower name>|<borrower id>
+//	returnBook <title>|<borrower name>|<borrower id>
+//	editCategory <category/sub-category/...>|<new name>
+//Results are written to output(). Returns false for a command it does not
+//know; help and exit are left to the caller. A replica refuses the commands
+//that change the catalog.
+bool executeCommand(LCMS& lcms, const Command& command);
+
+//What the batch mode, the server and the prompt run commands against: a
+//single LCMS, a catalog split in shards (see shards.h) or a catalog image
+//used in place (see mapped.h).
+class CommandTarget
+{
+	public:
+		virtual ~CommandTarget() {}
+		virtual bool execute(const Command& command) = 0;	//as executeCommand
+};
+
+//a single LCMS
+class CatalogTarget : public CommandTarget
+{
+	private:
+		LCMS& lcms;
+	public:
+		CatalogTarget(LCMS& lcms) : lcms(lcms) {}
+		bool execute(const Command& command) { return executeCommand(lcms, command); }
+};
+
+//Run a command on the calling thread and return what it printed, including
+//"Invalid Command!" for unknown commands and the help screen for "help".
+string runCommand(CommandTarget& target, const Command& command);
+
+//true for commands that only look at the catalog, so that several of them
+//can run side by side
+bool isReadOnly(const Command& command);
+
+//true for commands that change the catalog
+bool changesCatalog(const Command& command);
+
+//On a replica, print why a command that changes the catalog is not run and
+//return true; false otherwise.
+bool refuseChange(LCMS& lcms, const Command& command);
+
+//print the list of commands (the help screen)
+void listCommands(ostream& out);
+#endif
@@ -0,0 +1,183 @@
+#include "csvscan.h"
+#include <cstring>
+#include <stdint.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define CSV_HAVE_X86 1
+#include <immintrin.h>
+#endif
+
+using namespace std;
+
+// a block classifier sets bit i of `structural` when block[i] is '"' or ','
+// and bit i of `newlines` when block[i] is '\n'
+typedef void (*BlockClassifier)(const char* block, uint32_t& structural, uint32_t& newlines);
+
+static void classifyScalar(const char* block, size_t len, uint32_t& structural, uint32_t& newlines) {
+    structural = 0;
+    newlines = 0;
+    for (size_t i = 0; i < len; i++) {
+        if (block[i] == '"' || block[i] == ',') structural |= (uint32_t)1 << i;
+        else if (block[i] == '\n') newlines |= (uint32_t)1 << i;
+    }
+}
+
+#ifdef CSV_HAVE_X86
+// 16 bytes per call, SSE2 is part of the x86-64 baseline
+__attribute__((target("sse2")))
+static void classifySSE2(const char* block, uint32_t& structural, uint32_t& newlines) {
+    __m128i bytes = _mm_loadu_si128((const __m128i*)block);
+    __m128i quotes = _mm_cmpeq_epi8(bytes, _mm_set1_epi8('"'));
+    __m128i commas = _mm_cmpeq_epi8(bytes, _mm_set1_epi8(','));
+    __m128i breaks = _mm_cmpeq_epi8(bytes, _mm_set1_epi8('\n'));
+    structural = (uint32_t)_mm_movemask_epi8(_mm_or_si128(quotes, commas));
+    newlines = (uint32_t)_mm_movemask_epi8(breaks);
+}
+
+// 32 bytes per call, only used when the cpu reports AVX2
+__attribute__((target("avx2")))
+static void classifyAVX2(const char* block, uint32_t& structural, uint32_t& newlines) {
+    __m256i bytes = _mm256_loadu_si256((const __m256i*)block);
+    __m256i quotes = _mm256_cmpeq_epi8(bytes, _mm256_set1_epi8('"'));
+    __m256i commas = _mm256_cmpeq_epi8(bytes, _mm256_set1_epi8(','));
+    __m256i breaks = _mm256_cmpeq_epi8(bytes, _mm256_set1_epi8('\n'));
+    structural = (uint32_t)_mm256_movemask_epi8(_mm256_or_si256(quotes, commas));
+    newlines = (uint32_t)_mm256_movemask_epi8(breaks);
+}
+#endif
+
+// the classifier used for this process, picked once on first use
+struct Scanner {
+    BlockClassifier classify;
+    size_t width;       // bytes per block, 0 for the scalar scanner
+    const char* name;
+};
+
+// the scanner with a given name, if this cpu supports it
+static bool makeScanner(const string& name, Scanner& scanner) {
+    if (name == "scalar") {
+        scanner = { nullptr, 0, "scalar" };
+        return true;
+    }
+#ifdef CSV_HAVE_X86
+    __builtin_cpu_init();
+    if (name == "avx2" && __builtin_cpu_supports("avx2")) {
+        scanner = { classifyAVX2, 32, "avx2" };
+        return true;
+    }
+    if (name == "sse2" && __builtin_cpu_supports("sse2")) {
+        scanner = { classifySSE2, 16, "sse2" };
+        return true;
+    }
+#endif
+    return false;
+}
+
+static Scanner pickScanner() {
+    Scanner scanner;
+    if (makeScanner("avx2", scanner) || makeScanner("sse2", scanner)) return scanner;
+    makeScanner("scalar", scanner);
+    return scanner;
+}
+
+static Scanner& scanner() {
+    static Scanner picked = pickScanner();
+    return picked;
+}
+
+const char* csvScannerName() {
+    return scanner().name;
+}
+
+bool csvUseScanner(const string& name) {
+    return makeScanner(name, scanner());
+}
+
+void csvSplitLineScalar(const string& line, MyVector<string>& fields) {
+    string currentField;
+    bool inQuotes = false; // flag for quoted fields
+
+    for (size_t i = 0; i < line.length(); i++) {
+        if (line[i] == '"') {
+            inQuotes = !inQuotes; // toggle the inQuotes flag
+        }
+        else if (line[i] == ',' && !inQuotes) {
+            fields.push_back(currentField); // add field to vector
+            currentField.clear(); // clear current field
+        }
+        else {
+            currentField += line[i]; // append character to current field
+        }
+    }
+    fields.push_back(currentField); // add the last field
+}
+
+void csvSplitLine(const string& line, MyVector<string>& fields) {
+    const Scanner& scan = scanner();
+    const char* data = line.data();
+    size_t len = line.length();
+
+    string currentField;
+    bool inQuotes = false;
+    size_t runStart = 0; // first byte not yet copied into currentField
+    size_t block = 0;
+
+    while (block < len) {
+        size_t width = scan.width;
+        uint32_t structural, newlines;
+        if (width != 0 && len - block >= width) {
+            scan.classify(data + block, structural, newlines);
+        }
+        else {
+            width = min(len - block, (size_t)32); // tail (or no SIMD at all)
+            classifyScalar(data + block, width, structural, newlines);
+        }
+
+        // only the quotes and commas need a decision, plain runs are copied whole
+        while (structural != 0) {
+            size_t pos = block + __builtin_ctz(structural);
+            currentField.append(data + runStart, pos - runStart);
+            runStart = pos + 1;
+
+            if (data[pos] == '"') {
+                inQuotes = !inQuotes;
+            }
+            else if (inQuotes) {
+                currentField += ','; // comma inside a quoted field
+            }
+            else {
+                fields.push_back(currentField);
+                currentField.clear();
+            }
+            structural &= structural - 1; // next set bit
+        }
+        block += width;
+    }
+
+    currentField.append(data + runStart, len - runStart);
+    fields.push_back(currentField); // add the last field
+}
+
+size_t csvFindNewline(const char* data, size_t len) {
+    const Scanner& scan = scanner();
+    if (scan.width == 0) {
+        const void* found = memchr(data, '\n', len); // no SIMD scanner on this cpu
+        return found ? (const char*)found - data : len;
+    }
+
+    size_t block = 0;
+    while (block < len) {
+        size_t width = scan.width;
+        uint32_t structural, newlines;
+        if (width != 0 && len - block >= width) {
+            scan.classify(data + block, structural, newlines);
+        }
+        else {
+            width = min(len - block, (size_t)32);
+            classifyScalar(data + block, width, structural, newlines);
+        }
+        if (newlines != 0) return block + __builtin_ctz(newlines);
+        block += width;
+    }
+    return len;
+}
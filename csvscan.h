@@ -0,0 +1,37 @@
+//============================================================================
+// Name         : csvscan.h
+// Author       :
+// Version      : 1.0
+// Date Created :
+// Date Modified:
+// Description  : Vectorized CSV field scanner used by the import
+//============================================================================
+#ifndef _CSVSCAN_H
+#define _CSVSCAN_H
+#include<string>
+#include<cstddef>
+#include "myvector.h"
+using namespace std;
+
+//Split one CSV line into fields. The rules are the ones the import has always
+//used: a '"' toggles quoting and is dropped, a ',' outside quotes ends a field,
+//every other byte is copied. The line is classified 16 (SSE2) or 32 (AVX2)
+//bytes at a time so that plain runs are copied in one go; the instruction set
+//is picked once at runtime, with a scalar fallback on other platforms.
+void csvSplitLine(const string& line, MyVector<string>& fields);
+
+//Same as csvSplitLine, restricted to the scalar byte-by-byte loop; the
+//reference the vectorized scanners are checked against (tests/csvscan_check)
+void csvSplitLineScalar(const string& line, MyVector<string>& fields);
+
+//Return the offset of the first '\n' in data[0..len), or len if there is none
+size_t csvFindNewline(const char* data, size_t len);
+
+//Name of the scanner in use ("avx2", "sse2" or "scalar")
+const char* csvScannerName();
+
+//Use a given scanner instead of the best one the cpu has, false if the cpu
+//lacks it. For the check and the benchmark: not safe while lines are split
+bool csvUseScanner(const string& name);
+
+#endif
@@ -0,0 +1,110 @@
+#include "feed.h"
+#include "lcms.h"
+#include "output.h"
+#include <sstream>
+#include <cstring>
+#include <cerrno>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+
+using namespace std;
+
+FeedFollower::FeedFollower(LCMS& lcms, const string& path, long long offset)
+    : lcms(lcms), path(path), worker(nullptr), stopping(false), offset(offset), rows(0), halted(false),
+      device(0), inode(0), buffer(new char[FEED_CHUNK]) {}
+
+FeedFollower::~FeedFollower() {
+    stop();
+    delete[] buffer;
+}
+
+void FeedFollower::start() {
+    if (worker) return;
+    stopping = false;
+    worker = new thread(&FeedFollower::run, this);
+}
+
+void FeedFollower::stop() {
+    if (!worker) return;
+    stopping = true;
+    worker->join();
+    delete worker;
+    worker = nullptr;
+}
+
+const string& FeedFollower::file() const {
+    return path;
+}
+
+long long FeedFollower::position() const {
+    return offset;
+}
+
+unsigned long FeedFollower::imported() const {
+    return rows;
+}
+
+bool FeedFollower::failed() const {
+    return halted;
+}
+
+void FeedFollower::pause(int milliseconds) {
+    for (int waited = 0; waited < milliseconds && !stopping; waited += FEED_POLL_MS) {
+        this_thread::sleep_for(chrono::milliseconds(FEED_POLL_MS));
+    }
+}
+
+void FeedFollower::run() {
+    ostream discard(nullptr); // imported rows would print their messages
+    OutputRedirect quiet(discard);
+
+    while (!stopping) {
+        poll();
+        pause(FEED_POLL_MS);
+    }
+}
+
+void FeedFollower::poll() {
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC); // opened again every time, the file may be replaced
+    if (fd < 0) return; // gone for now, maybe being rotated
+    struct stat info;
+    if (fstat(fd, &info) != 0) {
+        close(fd);
+        return;
+    }
+    bool replaced = inode != 0 && (info.st_dev != device || info.st_ino != inode);
+    if (replaced || info.st_size < offset) {
+        cerr << "feed: " << path << (replaced ? " was replaced" : " shrank below the rows imported")
+            << ", stopped following it (its rows could be imported twice)" << endl;
+        halted = true;
+        stopping = true;
+        close(fd);
+        return;
+    }
+    device = info.st_dev;
+    inode = info.st_ino;
+
+    string pending; // read, not yet a whole row
+    long long position = offset;
+    while (!stopping && position < info.st_size) {
+        ssize_t got = pread(fd, buffer, FEED_CHUNK, position);
+        if (got < 0 && errno == EINTR) continue;
+        if (got <= 0) break;
+        position += got;
+        pending.append(buffer, got);
+
+        size_t end = pending.rfind('\n');
+        if (end == string::npos) continue; // a row longer than the chunk
+        size_t start = 0;
+        if (offset == 0) start = pending.find('\n') + 1; // the header line
+
+        istringstream whole(pending.substr(start, end + 1 - start));
+        int added = lcms.importRows(whole);
+        if (added > 0) rows += added;
+        offset += end + 1;
+        pending.erase(0, end + 1);
+        lcms.feedImported(path, offset);
+    }
+    close(fd);
+}
@@ -0,0 +1,60 @@
+//============================================================================
+// Name         : feed.h
+// Author       :
+// Version      : 1.0
+// Date Created :
+// Date Modified:
+// Description  : Import of the rows appended to a growing csv file
+//============================================================================
+#ifndef _FEED_H
+#define _FEED_H
+#include<string>
+#include<thread>
+#include<atomic>
+#include<sys/types.h>
+using namespace std;
+
+#define FEED_POLL_MS 250			//longest an appended row waits before it is imported
+#define FEED_CHUNK 1048576			//bytes of the file read at a time
+
+class LCMS;
+
+//Follows a csv file that another program appends rows to (import --follow).
+//A thread checks the size of the file every FEED_POLL_MS, reads what was
+//appended since the end of the last whole row it imported, and hands the whole
+//rows to LCMS::importRows, which inserts them IMPORT_BATCH_ROWS at a time. A
+//row still being written is left for the next check. The file is never read
+//again from the start: if it shrinks below what was imported or another file
+//takes its name (a new inode), the follower cannot tell which rows are new and
+//stops with an error instead of importing the old ones a second time.
+class FeedFollower
+{
+	private:
+		LCMS& lcms;
+		string path;
+		thread* worker;
+		atomic<bool> stopping;
+		atomic<long long> offset;		//end of the last whole row imported (0: the header is still to skip)
+		atomic<unsigned long> rows;		//records imported
+		atomic<bool> halted;			//stopped on its own, the file was truncated or replaced
+		dev_t device;					//device and inode of the file followed (inode 0 until the first poll)
+		ino_t inode;
+		char* buffer;					//FEED_CHUNK bytes, reused by every poll
+
+		FeedFollower(const FeedFollower&);				//not copyable
+		FeedFollower& operator=(const FeedFollower&);
+		void run();
+		void poll();					//import the whole rows appended since the last poll
+		void pause(int milliseconds);	//sleep, cut short by stop()
+
+	public:
+		FeedFollower(LCMS& lcms, const string& path, long long offset);
+		~FeedFollower();
+		void start();
+		void stop();
+		const string& file() const;
+		long long position() const;		//bytes of the file imported
+		unsigned long imported() const;	//records imported
+		bool failed() const;			//true once the file was truncated or replaced (the follower has stopped)
+};
+#endif
@@ -0,0 +1,46 @@
+#include "journal.h"
+
+using namespace std;
+
+ChangeJournal::ChangeJournal() : first(1), last(0) {}
+
+void ChangeJournal::append(const ChangeEntry& entry) {
+    entries.push_back(entry);
+    last++;
+    if (entries.size() > JOURNAL_HISTORY) {
+        entries.pop_front(); // checkpoints before it can no longer be followed
+        first++;
+    }
+}
+
+void ChangeJournal::record(ChangeKind kind, const Book& book) {
+    ChangeEntry entry;
+    entry.kind = kind;
+    entry.book = book.id;
+    entry.isbn = book.isbn;
+    append(entry);
+}
+
+void ChangeJournal::recordDelete(const Book& book, const string& category) {
+    ChangeEntry entry;
+    entry.kind = CHANGE_DELETE;
+    entry.book = book.id;
+    entry.isbn = book.isbn;
+    DeletedRow* gone = new DeletedRow;
+    gone->row = BookRow(book);
+    gone->category = category;
+    entry.deleted.reset(gone);
+    append(entry);
+}
+
+unsigned long ChangeJournal::checkpoint() const {
+    return last;
+}
+
+bool ChangeJournal::since(unsigned long checkpoint, MyVector<ChangeEntry>& changes) const {
+    if (checkpoint + 1 < first || checkpoint > last) return false;
+    for (unsigned long number = checkpoint + 1; number <= last; number++) {
+        changes.push_back(entries[number - first]);
+    }
+    return true;
+}
@@ -0,0 +1,74 @@
+//============================================================================
+// Name         : journal.h
+// Author       :
+// Version      : 1.0
+// Date Created :
+// Date Modified:
+// Description  : Journal of changed books for incremental exports
+//============================================================================
+#ifndef _JOURNAL_H
+#define _JOURNAL_H
+#include<string>
+#include<deque>
+#include<stdint.h>
+#include<memory>
+#include "myvector.h"
+#include "snapshot.h"
+#include "book.h"
+using namespace std;
+
+#define JOURNAL_HISTORY 262144		//changes remembered for export --since; older checkpoints need a full export
+
+enum ChangeKind
+{
+	CHANGE_INSERT = 1,
+	CHANGE_UPDATE = 2,
+	CHANGE_DELETE = 3
+};
+
+//a deleted row as it was, kept out of ChangeEntry so that inserts and updates stay small
+struct DeletedRow
+{
+	BookRow row;
+	string category;
+};
+
+//one change of one exported row
+struct ChangeEntry
+{
+	ChangeKind kind;
+	uint32_t book;			//Book::id
+	string isbn;			//isbn of the book when it changed; exported rows are keyed by isbn
+	shared_ptr<const DeletedRow> deleted;	//deletes only
+};
+
+//The journal numbers every change of a book; a checkpoint is the number of the
+//last change an export saw. Changes older than JOURNAL_HISTORY are forgotten.
+//An insert or update costs about 60 bytes (an isbn longer than 15 characters
+//adds its length), a delete also keeps the row, so the history stays within
+//JOURNAL_HISTORY * 60 bytes (15 MB) plus the rows of the deletes in it.
+//
+//Not synchronised. LCMS changes and reads it either with catalogLock held
+//exclusively or with catalogLock shared and journalGuard held, the way borrow
+//and return record their changes.
+class ChangeJournal
+{
+	private:
+		deque<ChangeEntry> entries;		//entries[i] is change number first + i
+		unsigned long first;			//number of entries[0]
+		unsigned long last;				//number of the latest change, the current checkpoint
+
+		ChangeJournal(const ChangeJournal&);			//not copyable
+		ChangeJournal& operator=(const ChangeJournal&);
+		void append(const ChangeEntry& entry);
+
+	public:
+		ChangeJournal();
+		void record(ChangeKind kind, const Book& book);				//a book was added (insert) or changed (update)
+		void recordDelete(const Book& book, const string& category);	//a book is about to leave the catalog
+		unsigned long checkpoint() const;								//number of the latest change (0 before any)
+		//the changes after a checkpoint, oldest first; false if the checkpoint is
+		//older than the history or newer than the journal
+		bool since(unsigned long checkpoint, MyVector<ChangeEntry>& changes) const;
+};
+#endif
@@ -0,0 +1,35 @@
+//============================================================================
+// Name         : keyhash.h
+// Author       :
+// Version      : 1.0
+// Date Created :
+// Date Modified:
+// Description  : Precomputed hash and length of a lookup key
+//============================================================================
+#ifndef _KEYHASH_H
+#define _KEYHASH_H
+#include<string>
+#include<functional>
+
+//hash and length of a key (book title, isbn, borrower id) kept next to the key,
+//so that almost every mismatch is rejected on an integer compare
+struct KeyHash
+{
+	size_t hash;
+	size_t length;
+};
+
+inline KeyHash hashKey(const std::string& key)
+{
+	KeyHash k;
+	k.hash = std::hash<std::string>()(key);
+	k.length = key.length();
+	return k;
+}
+
+//true if `key` (with precomputed hash keyHash) equals `probe` (with hash probeHash)
+inline bool sameKey(const std::string& key, const KeyHash& keyHash, const std::string& probe, const KeyHash& probeHash)
+{
+	return keyHash.hash == probeHash.hash && keyHash.length == probeHash.length && key == probe;
+}
+#endif
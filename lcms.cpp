@@ -1,18 +1,42 @@
 #include "lcms.h"
+#include "csvscan.h"
+#include "output.h"
+#include "feed.h"
+#include "spscring.h"
 #include <iostream>
 #include <fstream>
 #include <sstream>
 #include <stdexcept>
+#include <ctime>
+#include <iomanip>
+#include <cstdio>
+#include <unordered_set>
+#include <initializer_list>
+#include <unistd.h>
+#include <thread>
+#include <chrono>
 
 using namespace std;
 
+// fields of a write-ahead log record
+static MyVector<string> logRecord(initializer_list<string> values) {
+    MyVector<string> fields;
+    for (const string& value : values) fields.push_back(value);
+    return fields;
+}
+
 // constructor for LCMS class
-LCMS::LCMS(string name) {
+LCMS::LCMS(string name) : staleKeys(0), titleProbes(0), titleMisses(0), titleFalsePositives(0),
+    isbnProbes(0), isbnMisses(0), isbnFalsePositives(0), wal(nullptr), replica(false) {
     libTree = new Tree("lib"); // create a new tree with root named 'lib'
 }
 
 // destructor for LCMS class
 LCMS::~LCMS() {
+    for (int i = 0; i < followers.size(); i++) {
+        delete followers[i]; // stops its thread, which imports into this catalog
+    }
+    delete wal; // writes out what is still buffered
     delete libTree; // delete the tree to free memory
     // delete all borrowers to free memory
     for (int i = 0; i < borrowers.size(); i++) {
@@ -24,166 +48,759 @@ LCMS::~LCMS() {
 int LCMS::import(string path) {
     ifstream testFile(path); // try to open the file
     if (!testFile.good()) {
-        cout << "error: file does not exist or cannot be accessed at: " << path << endl;
+        output() << "error: file does not exist or cannot be accessed at: " << path << endl;
         return 0; // return if file cannot be opened
     }
     testFile.close();
 
     ifstream file(path); // open the file for reading
     if (!file.is_open()) {
-        cout << "error opening file at: " << path << endl;
+        output() << "error opening file at: " << path << endl;
         return 0; // return if file cannot be opened
     }
 
-    try {
-        int importedCount = 0; // count of records imported
-        string line;
-        bool firstLine = true; // flag to skip the header line
+    string header;
+    getline(file, header); // skip the header line
+    ImportTimings timings;
+    int importedCount = importRows(file, &timings);
+    file.close();
+    if (importedCount < 0) return 0; // reported by importRows
 
-        while (getline(file, line)) {
-            if (firstLine) {
-                firstLine = false; // skip the first line
-                continue;
-            }
+    output() << importedCount << " records have been imported." << endl;
+    output() << "import stages (busy/waiting ms): read " << (long)timings.read.busyMs << "/" << (long)timings.read.waitMs
+        << ", parse " << (long)timings.parse.busyMs << "/" << (long)timings.parse.waitMs
+        << ", insert " << (long)timings.insert.busyMs << "/" << (long)timings.insert.waitMs << endl;
+    return importedCount; // return the number of records imported
+}
+
+// parsed rows on their way from the parser to the inserter
+struct ImportBatch
+{
+    MyVector<Book*> books;
+    MyVector<string> categories;
+};
 
-            if (line.empty()) continue; // skip empty lines
+typedef chrono::steady_clock ImportClock;
 
-            MyVector<string> fields; // vector to store the fields
-            string currentField;
-            bool inQuotes = false; // flag for quoted fields
+static double millisSince(ImportClock::time_point start) {
+    return chrono::duration<double, milli>(ImportClock::now() - start).count();
+}
 
-            // parse the line into fields
-            for (size_t i = 0; i < line.length(); i++) {
-                if (line[i] == '"') {
-                    inQuotes = !inQuotes; // toggle the inQuotes flag
+// free a batch that was parsed but never inserted
+static void discardBatch(ImportBatch* batch) {
+    if (!batch) return;
+    for (int i = 0; i < batch->books.size(); i++) {
+        if (!batch->books[i]) continue; // insertBatch took it over before it failed
+        delete batch->books[i];
+    }
+    delete batch;
+}
+
+// the time a stage ran, split into the time it spent waiting on its neighbours
+static void stageDone(StageTiming& timing, ImportClock::time_point start, double waited) {
+    timing.waitMs = waited;
+    timing.busyMs = millisSince(start) - waited;
+}
+
+// function to import csv rows
+int LCMS::importRows(istream& rows, ImportTimings* timings) {
+    // three stages on three threads: the reader reads the input in blocks,
+    // the parser cuts them into lines and turns those into batches of
+    // IMPORT_BATCH_ROWS books without the lock and the calling thread inserts
+    // each batch under one write lock, so queries keep running during a long
+    // import. The rings between them are bounded, a stage that runs ahead
+    // waits for the next one
+    SpscRing<string*> blocks(IMPORT_RING_SLOTS);
+    SpscRing<ImportBatch*> batches(IMPORT_RING_SLOTS);
+    atomic<bool> failed(false);
+    ImportTimings spent;
+    ostringstream parserOutput; // replayed on the calling thread, whose output() may be redirected
+
+    // any stage that fails stops the other two
+    auto fail = [&]() {
+        failed = true;
+        blocks.cancel();
+        batches.cancel();
+    };
+
+    thread reader([&]() {
+        ImportClock::time_point start = ImportClock::now();
+        double waited = 0;
+        try {
+            while (rows) {
+                string* block = new string(IMPORT_BLOCK_BYTES, '\0');
+                rows.read(&(*block)[0], IMPORT_BLOCK_BYTES);
+                streamsize got = rows.gcount();
+                if (got <= 0) {
+                    delete block;
+                    break;
                 }
-                else if (line[i] == ',' && !inQuotes) {
-                    fields.push_back(currentField); // add field to vector
-                    currentField.clear(); // clear current field
+                block->resize(got); // lines run across blocks, the parser joins them
+                ImportClock::time_point wait = ImportClock::now();
+                bool queued = blocks.pushWait(block);
+                waited += millisSince(wait);
+                if (!queued) {
+                    delete block;
+                    break;
                 }
-                else {
-                    currentField += line[i]; // append character to current field
+            }
+        }
+        catch (...) {
+            fail();
+        }
+        blocks.close();
+        stageDone(spent.read, start, waited);
+    });
+
+    thread parser([&]() {
+        OutputRedirect redirect(parserOutput);
+        ImportClock::time_point start = ImportClock::now();
+        double waited = 0;
+        ImportBatch* batch = nullptr;
+        string* block = nullptr;
+        string line; // the line being put together, it may start in an earlier block
+
+        // add a line to the batch and queue the batch once it is full, false if the inserter stopped
+        auto parseLine = [&]() {
+            if (line.empty()) return true; // skip empty lines
+            string category;
+            Book* newBook = parseRow(line, category);
+            if (!newBook) return true; // reported by parseRow
+
+            if (!batch) batch = new ImportBatch;
+            batch->books.push_back(newBook);
+            batch->categories.push_back(category);
+            if (batch->books.size() < IMPORT_BATCH_ROWS) return true;
+            ImportClock::time_point wait = ImportClock::now();
+            bool queued = batches.pushWait(batch);
+            waited += millisSince(wait);
+            if (queued) batch = nullptr;
+            return queued;
+        };
+
+        try {
+            while (true) {
+                ImportClock::time_point wait = ImportClock::now();
+                bool more = blocks.popWait(block);
+                waited += millisSince(wait);
+                if (!more) break;
+
+                const char* data = block->data();
+                size_t length = block->length();
+                size_t begin = 0;
+                while (begin < length) {
+                    size_t end = begin + csvFindNewline(data + begin, length - begin);
+                    line.append(data + begin, end - begin);
+                    if (end == length) break; // the line goes on in the next block
+                    begin = end + 1;
+                    if (!parseLine()) break;
+                    line.clear();
                 }
+                delete block;
+                block = nullptr;
+                if (batches.isCancelled()) break;
             }
-            fields.push_back(currentField); // add the last field
+            if (!batches.isCancelled()) parseLine(); // the last line, without a newline
+            if (batch && !batches.isCancelled() && batches.pushWait(batch)) batch = nullptr;
+        }
+        catch (...) {
+            fail();
+        }
+        delete block;
+        discardBatch(batch); // parsed but never queued
+        batches.close();
+        stageDone(spent.parse, start, waited);
+    });
+
+    int importedCount = 0; // count of records imported
+    ImportClock::time_point start = ImportClock::now();
+    double waited = 0;
+    ImportBatch* batch = nullptr;
+    try {
+        while (true) {
+            ImportClock::time_point wait = ImportClock::now();
+            bool more = batches.popWait(batch);
+            waited += millisSince(wait);
+            if (!more) break;
+            importedCount += insertBatch(batch->books, batch->categories);
+            delete batch;
+            batch = nullptr;
+        }
+    }
+    catch (...) {
+        fail();
+    }
+    reader.join();
+    parser.join();
+    stageDone(spent.insert, start, waited);
+    output() << parserOutput.str();
+
+    // whatever a failure left in the rings was never inserted
+    discardBatch(batch);
+    string* block;
+    while (blocks.pop(block)) delete block;
+    while (batches.pop(batch)) discardBatch(batch);
+    if (failed) {
+        output() << "fatal error occurred during import" << endl;
+        return -1;
+    }
+
+    if (importedCount > 0) {
+        WriteGuard lock(catalogLock);
+        rebuildFilters(); // sized for the new catalog
+    }
+    if (timings) *timings = spent;
+    return importedCount;
+}
+
+// function to start following a growing csv file
+void LCMS::follow(const string& path) {
+    if (access(path.c_str(), R_OK) != 0) {
+        output() << "error: file does not exist or cannot be accessed at: " << path << endl;
+        return;
+    }
+
+    lock_guard<mutex> feeds(feedGuard);
+    for (int i = 0; i < followers.size(); i++) {
+        if (followers[i]->file() == path) {
+            output() << "already following " << path << endl;
+            return;
+        }
+    }
+    long long offset = feedOffsets[path]; // where the last follower stopped, 0 for a new file
+    FeedFollower* follower = new FeedFollower(*this, path, offset);
+    followers.push_back(follower);
+    follower->start();
+    output() << "following " << path << " from byte " << offset << endl;
+}
 
-            if (fields.size() != 7) {
-                cout << "skipping line: invalid number of fields" << endl;
-                continue; // skip lines with incorrect number of fields
+// function to stop following a file
+void LCMS::unfollow(const string& path) {
+    FeedFollower* follower = nullptr;
+    {
+        lock_guard<mutex> feeds(feedGuard);
+        for (int i = 0; i < followers.size(); i++) {
+            if (followers[i]->file() != path) continue;
+            follower = followers[i];
+            followers.erase(i);
+            break;
+        }
+    }
+    if (!follower) {
+        output() << "not following " << path << endl;
+        return;
+    }
+
+    follower->stop(); // outside feedGuard: the thread takes it to report progress
+    output() << "stopped following " << path << " at byte " << follower->position() << ", "
+        << follower->imported() << " records imported" << endl;
+    delete follower;
+}
+
+// function to remember how far a followed file has been imported
+void LCMS::feedImported(const string& path, long long offset) {
+    DurableChange change(wal);
+    lock_guard<mutex> feeds(feedGuard);
+    feedOffsets[path] = offset;
+    change.record(logRecord({ "feed", path, to_string(offset) })); // after the rows: a crash in between imports them again
+}
+
+// function to parse one csv row into a new book
+Book* LCMS::parseRow(const string& line, string& category) {
+    MyVector<string> fields; // vector to store the fields
+    csvSplitLine(line, fields); // parse the line into fields
+
+    if (fields.size() != 7) {
+        output() << "skipping line: invalid number of fields" << endl;
+        return nullptr; // skip lines with incorrect number of fields
+    }
+
+    try {
+        // remove quotes from fields if present
+        for (int i = 0; i < fields.size(); i++) {
+            if (fields[i].length() >= 2 && fields[i].front() == '"' && fields[i].back() == '"') {
+                fields[i] = fields[i].substr(1, fields[i].length() - 2); // remove quotes
             }
+        }
 
-            try {
-                // remove quotes from fields if present
-                for (int i = 0; i < fields.size(); i++) {
-                    if (fields[i].length() >= 2 && fields[i].front() == '"' && fields[i].back() == '"') {
-                        fields[i] = fields[i].substr(1, fields[i].length() - 2); // remove quotes
-                    }
-                }
+        // assign fields to variables
+        string title = fields[0];
+        string author = fields[1];
+        string isbn = fields[2];
+        int publication_year = stoi(fields[3]);
+        int total_copies = stoi(fields[5]);
+        int available_copies = stoi(fields[6]);
+
+        // check for invalid numeric values
+        if (total_copies < 0 || available_copies < 0) {
+            output() << "skipping line: invalid numeric values" << endl;
+            return nullptr; // skip if numeric values are invalid
+        }
 
-                // assign fields to variables
-                string title = fields[0];
-                string author = fields[1];
-                string isbn = fields[2];
-                int publication_year = stoi(fields[3]);
-                string category = fields[4];
-                int total_copies = stoi(fields[5]);
-                int available_copies = stoi(fields[6]);
-
-                // check for invalid numeric values
-                if (total_copies < 0 || available_copies < 0) {
-                    cout << "skipping line: invalid numeric values" << endl;
-                    continue; // skip if numeric values are invalid
-                }
+        // check if available copies exceed total copies
+        if (available_copies > total_copies) {
+            output() << "skipping line: available copies greater than total copies" << endl;
+            return nullptr; // skip if available copies exceed total copies
+        }
 
-                // check if available copies exceed total copies
-                if (available_copies > total_copies) {
-                    cout << "skipping line: available copies greater than total copies" << endl;
-                    continue; // skip if available copies exceed total copies
-                }
+        category = fields[4];
+        return new Book(title, author, isbn, publication_year, total_copies, available_copies);
+    }
+    catch (const std::exception& e) {
+        output() << "error processing line: " << e.what() << endl;
+        return nullptr; // skip on exception
+    }
+}
 
-                // create a new book object
-                Book* newBook = new Book(title, author, isbn, publication_year, total_copies, available_copies);
-                if (!newBook) {
-                    cout << "failed to create book object" << endl;
-                    continue; // continue if book creation fails
-                }
+// function to bring the catalog in line with a new version of the catalog file
+int LCMS::reimport(string path) {
+    ifstream file(path);
+    if (!file.is_open()) {
+        output() << "error: file does not exist or cannot be accessed at: " << path << endl;
+        return -1;
+    }
 
-                // create or get the category node
-                Node* categoryNode = libTree->createNode(category);
-                if (!categoryNode) {
-                    cout << "failed to create category node for: " << category << endl;
-                    delete newBook; // delete the book if category node creation fails
-                    continue;
-                }
+    // parse and index the whole feed without the lock
+    string line;
+    getline(file, line); // skip the header line
+    MyVector<Book*> rows;
+    MyVector<string> rowCategories;
+    unordered_map<string, int> rowByIsbn; // isbn -> index in rows
+    while (getline(file, line)) {
+        if (line.empty()) continue;
+        string category;
+        Book* row = parseRow(line, category);
+        if (!row) continue;
+        if (!rowByIsbn.insert(make_pair(row->isbn, rows.size())).second) {
+            output() << "skipping line: duplicate isbn " << row->isbn << endl;
+            delete row;
+            continue;
+        }
+        rows.push_back(row);
+        rowCategories.push_back(category);
+    }
+    file.close();
 
-                // add the book to the category
-                categoryNode->books.push_back(newBook);
-                categoryNode->bookCount++; // increment the book count
+    int inserted = 0, updated = 0, deleted = 0, unchanged = 0;
+    {
+        DurableChange change(wal);
+        WriteGuard lock(catalogLock);
+
+        // match every book to the row with its isbn; of several books with one
+        // isbn (left by repeated imports) the one with the most circulation stays
+        MyVector<Book*> matches;
+        MyVector<Book*> gone;
+        for (int i = 0; i < rows.size(); i++) matches.push_back(nullptr);
+        for (int id = 0; id < libTree->bookSlots(); id++) {
+            Book* book = libTree->bookAt(id);
+            if (!book) continue;
+            unordered_map<string, int>::iterator row = rowByIsbn.find(book->isbn);
+            if (row == rowByIsbn.end()) {
+                gone.push_back(book);
+                continue;
+            }
+            Book*& match = matches[row->second];
+            if (match && (match->currentBorrowers.size() > book->currentBorrowers.size()
+                || (match->currentBorrowers.size() == book->currentBorrowers.size() && match->borrowerCount >= book->borrowerCount))) {
+                gone.push_back(book);
+                continue;
+            }
+            if (match) gone.push_back(match);
+            match = book;
+        }
 
-                // update book count in parent nodes
-                Node* current = categoryNode->parent;
-                while (current != nullptr) {
-                    current->bookCount++;
-                    current = current->parent;
+        for (int i = 0; i < gone.size(); i++) {
+            change.record(logRecord({ "drop", to_string(gone[i]->id) }));
+            dropBook(gone[i]);
+            deleted++;
+        }
+        keysRemoved(deleted);
+
+        for (int i = 0; i < rows.size(); i++) {
+            Book* row = rows[i];
+            if (matches[i]) {
+                if (updateBook(matches[i], *row, rowCategories[i])) {
+                    change.record(logRecord({ "update", to_string(matches[i]->id), row->title, row->author,
+                        to_string(row->publication_year), rowCategories[i], to_string(row->total_copies),
+                        to_string((int)row->available_copies) }));
+                    updated++;
                 }
-
-                importedCount++; // increment the count of imported records
+                else unchanged++;
+                continue;
             }
-            catch (const std::exception& e) {
-                cout << "error processing line: " << e.what() << endl;
-                continue; // continue on exception
+
+            Node* categoryNode = libTree->createNode(rowCategories[i]);
+            if (!categoryNode) {
+                output() << "failed to create category node for: " << rowCategories[i] << endl;
+                continue;
             }
+            attachBook(categoryNode, row);
+            rows[i] = nullptr; // now owned by the catalog
+            change.record(logRecord({ "book", row->title, row->author, row->isbn, to_string(row->publication_year),
+                rowCategories[i], to_string(row->total_copies), to_string((int)row->available_copies) }));
+            inserted++;
         }
+    }
+    for (int i = 0; i < rows.size(); i++) delete rows[i]; // the rows that matched a book
+
+    output() << "reimport: " << inserted << " inserted, " << updated << " updated, " << deleted << " deleted, "
+        << unchanged << " unchanged." << endl;
+    return inserted + updated + deleted;
+}
 
-        file.close();
-        cout << importedCount << " records have been imported." << endl;
-        return importedCount; // return the number of records imported
+// function to give a book the details of a row, returns false if they were the same already
+// (or the row cannot hold the book's open loans)
+bool LCMS::updateBook(Book* book, const Book& row, const string& category) {
+    // the feed does not know about our loans: the copies on loan come out of
+    // the copies it lists as available, so that every return still fits
+    int onLoan = book->currentBorrowers.size();
+    if (row.total_copies < onLoan) {
+        output() << "keeping " << book->title << ": " << onLoan << " copies are on loan, the new row has "
+            << row.total_copies << " copies" << endl;
+        return false;
     }
-    catch (...) {
-        file.close();
-        cout << "fatal error occurred during import" << endl;
-        return 0; // return zero on fatal error
+    int available = min((int)row.available_copies, row.total_copies) - onLoan;
+    if (available < 0) available = 0;
+
+    Node* categoryNode = libTree->nodeAt(book->category);
+    if (libTree->getCategory(categoryNode) != category) {
+        categoryNode = libTree->createNode(category); // the same node unless the path really differs
+        if (!categoryNode) return false;
+    }
+    if (book->title == row.title && book->author == row.author && book->publication_year == row.publication_year
+        && book->total_copies == row.total_copies && book->available_copies == available
+        && categoryNode->id == book->category) {
+        return false;
+    }
+
+    NodeStats before = Tree::bookStats(book);
+    if (book->title != row.title) {
+        book->title = row.title;
+        book->rehash();
+        titleFilter.insert(book->titleKey);
+        keysRemoved(1); // the old title is still in the filter
+    }
+    book->author = row.author;
+    book->publication_year = row.publication_year;
+    book->total_copies = row.total_copies;
+    book->available_copies = available; // loans stay open
+    NodeStats delta = Tree::bookStats(book);
+    delta.add(before, -1);
+    libTree->propagate(libTree->nodeAt(book->category), delta);
+    libTree->moveBook(book, categoryNode);
+    journal.record(CHANGE_UPDATE, *book);
+    return true;
+}
+
+// function to close the open loans of a book that leaves the catalog
+void LCMS::closeLoans(Book* book) {
+    for (int i = 0; i < book->currentBorrowers.capacity(); i++) {
+        if (book->currentBorrowers.at(i)) loans.closeLoan(book->id, book->currentBorrowers.at(i)->number);
     }
 }
 
+// function to close the open loans of every book of a subtree
+void LCMS::closeSubtreeLoans(Node* node) {
+    for (uint32_t b = node->firstBook; b != NO_BOOK; b = libTree->bookAt(b)->nextBook) {
+        closeLoans(libTree->bookAt(b));
+    }
+    for (uint32_t c = node->firstChild; c != NO_NODE; c = libTree->nodeAt(c)->nextSibling) {
+        closeSubtreeLoans(libTree->nodeAt(c));
+    }
+}
+
+// function to take a book out of the catalog with its open loans
+void LCMS::dropBook(Book* book) {
+    closeLoans(book);
+    journal.recordDelete(*book, libTree->getCategory(libTree->nodeAt(book->category)));
+    libTree->deleteBook(book);
+}
+
 // function to export data to a file
-void LCMS::exportData(string filename) {
+void LCMS::exportData(string filename, bool parallel) {
     ofstream file(filename);
     if (!file.is_open()) {
-        cout << "error: unable to open file for writing." << endl;
+        output() << "error: unable to open file for writing." << endl;
         return; // return if file cannot be opened
     }
 
     // write header line
     file << "Title,Author,ISBN,Publication Year,Category,Total Copies,Available Copies\n";
 
-    // export data from the tree
-    int count = libTree->exportData(libTree->getRoot(), file);
+    // the next export --since starts here; a change that lands between the
+    // checkpoint and the copy is exported again, never missed
+    unsigned long checkpoint;
+    {
+        ReadGuard lock(catalogLock); // see the lock rule of ChangeJournal
+        lock_guard<mutex> changes(journalGuard);
+        checkpoint = journal.checkpoint();
+    }
+
+    // copy the catalog under a brief lock, then write the copy out while
+    // checkouts and edits go on
+    SnapshotRef view = catalogSnapshot("");
+    int count = parallel ? exportSnapshotParallel(*view, "", file)
+                         : exportSnapshot(*view, "", file);
+
+    file.close();
+
+    output() << count << " records have been fully exported to file" << endl; // output total count
+    output() << "export checkpoint: " << checkpoint << endl;
+}
+
+// function to export the rows changed since an earlier export
+void LCMS::exportChanges(unsigned long checkpoint, string filename) {
+    // one row per book and isbn: an isbn edit deletes the old row and inserts a new one
+    struct Delta
+    {
+        ChangeKind first; // the first change after the checkpoint
+        uint32_t book;
+        string isbn;
+        int deleted; // index of the last delete in `changes`, -1 if none
+    };
+    MyVector<ChangeEntry> changes;
+    MyVector<Delta> deltas;
+    MyVector<string> kinds;
+    MyVector<BookRow> rows;
+    MyVector<string> categories;
+    unsigned long latest;
+    {
+        WriteGuard lock(catalogLock); // the rows must not change while they are copied
+        latest = journal.checkpoint();
+        if (!journal.since(checkpoint, changes)) {
+            output() << "unknown or expired checkpoint " << checkpoint << ", run a full export." << endl;
+            return;
+        }
+
+        unordered_map<string, int> byKey; // "<book id> <isbn>" -> index in deltas
+        for (int i = 0; i < changes.size(); i++) {
+            string key = to_string(changes[i].book) + " " + changes[i].isbn;
+            unordered_map<string, int>::iterator found = byKey.find(key);
+            if (found == byKey.end()) {
+                Delta delta;
+                delta.first = changes[i].kind;
+                delta.book = changes[i].book;
+                delta.isbn = changes[i].isbn;
+                delta.deleted = -1;
+                found = byKey.insert(make_pair(key, deltas.size())).first;
+                deltas.push_back(delta);
+            }
+            if (changes[i].kind == CHANGE_DELETE) deltas[found->second].deleted = i;
+        }
+
+        for (int i = 0; i < deltas.size(); i++) {
+            Book* book = libTree->bookAt(deltas[i].book);
+            if (book && book->isbn == deltas[i].isbn) {
+                kinds.push_back(deltas[i].first == CHANGE_INSERT ? "insert" : "update");
+                rows.push_back(BookRow(*book));
+                categories.push_back(libTree->getCategory(libTree->nodeAt(book->category)));
+            }
+            else if (deltas[i].first != CHANGE_INSERT && deltas[i].deleted >= 0) {
+                const ChangeEntry& gone = changes[deltas[i].deleted];
+                kinds.push_back("delete");
+                rows.push_back(gone.deleted->row);
+                categories.push_back(gone.deleted->category);
+            }
+            // added and removed again since the checkpoint: nothing to tell
+        }
+    }
 
+    ofstream file(filename);
+    if (!file.is_open()) {
+        output() << "error: unable to open file for writing." << endl;
+        return;
+    }
+    file << "Change,Title,Author,ISBN,Publication Year,Category,Total Copies,Available Copies\n";
+    for (int i = 0; i < rows.size(); i++) {
+        file << kinds[i] << ",";
+        rows[i].exportRow(file, categories[i]);
+    }
     file.close();
 
-    cout << count << " records have been fully exported to file" << endl; // output total count
+    output() << rows.size() << " changed records have been exported to file" << endl;
+    output() << "export checkpoint: " << latest << endl;
 }
 // function to find all books in a category path
 void LCMS::findAll(string categoryPath) {
+    // rendered output is reused until something below the category changes
+    string key = "findAll " + categoryPath;
+    string page;
+    {
+        ReadGuard lock(catalogLock);
+        Node* categoryNode = libTree->getNode(categoryPath);
+        if (!categoryNode) {
+            output() << "category not found: " << categoryPath << endl;
+            return;
+        }
+
+        unsigned long generation;
+        {
+            lock_guard<mutex> aggregates(statsGuard); // checkouts move it under a shared catalogLock
+            generation = categoryNode->generation;
+        }
+        if (results.lookup(key, generation, page)) {
+            output() << page << flush;
+            return;
+        }
+    }
+
+    // render from a point-in-time copy, without holding the catalog
+    SnapshotRef view = catalogSnapshot(categoryPath);
+    if (!view) {
+        output() << "category not found: " << categoryPath << endl;
+        return; // removed in the meantime
+    }
+    ostringstream rendered;
+    printSnapshot(*view, rendered); // print all books in the category
+    page = rendered.str();
+    results.store(key, view->generation, page);
+    output() << page << flush;
+}
+
+// function to check that a category exists
+bool LCMS::hasCategory(const string& categoryPath) {
+    ReadGuard lock(catalogLock);
+    return libTree->getNode(categoryPath) != nullptr;
+}
+
+// function to find the category of the book findBook shows; like locateIsbn
+// it leaves the filter counters to the lookup it routes
+bool LCMS::locateBook(const string& bookTitle, string& category) {
+    ReadGuard lock(catalogLock);
+    Book* book = lookupBook(bookTitle, false);
+    if (!book) return false;
+    category = libTree->getCategory(libTree->nodeAt(book->category));
+    return true;
+}
+
+// function to find the category of the book findIsbn shows
+bool LCMS::locateIsbn(const string& isbn, string& category) {
+    ReadGuard lock(catalogLock);
+    KeyHash isbnKey = hashKey(isbn);
+    if (!isbnFilter.mayContain(isbnKey)) return false;
+    Book* book = libTree->findBookByIsbn(libTree->getRoot(), isbn, isbnKey);
+    if (!book) return false;
+    category = libTree->getCategory(libTree->nodeAt(book->category));
+    return true;
+}
+
+// function to take a point-in-time copy of a category
+SnapshotRef LCMS::catalogSnapshot(const string& categoryPath) {
+    WriteGuard lock(catalogLock); // only the parts changed since the last copy are copied
     Node* categoryNode = libTree->getNode(categoryPath);
-    if (!categoryNode) {
-        cout << "category not found: " << categoryPath << endl;
-        return;
+    if (!categoryNode) return SnapshotRef();
+    return libTree->snapshot(categoryNode);
+}
+
+// function to copy the category tree with its aggregates
+void LCMS::categoryListing(CategoryListing& listing) {
+    ReadGuard lock(catalogLock);
+    lock_guard<mutex> aggregates(statsGuard); // the counts must not move during the copy
+    libTree->listing(libTree->getRoot(), listing);
+}
+
+// function to drop the books that never left the shelf
+int LCMS::releaseIdleBooks() {
+    WriteGuard lock(catalogLock);
+    int released = 0;
+    for (int id = 0; id < libTree->bookSlots(); id++) {
+        Book* book = libTree->bookAt(id);
+        if (!book || book->borrowerCount > 0 || book->currentBorrowers.size() > 0) continue;
+        libTree->deleteBook(book); // no loans, history or rankings refer to it
+        released++;
+    }
+    keysRemoved(released);
+    return released;
+}
+
+// function to display the catalog tree
+void LCMS::list(string options) {
+    ReadGuard lock(catalogLock);
+    lock_guard<mutex> aggregates(statsGuard); // the counts must not move during the render
+    Node* root = libTree->getRoot();
+    string key = "list " + options;
+    string page;
+    if (!results.lookup(key, root->generation, page)) {
+        ostringstream rendered;
+        libTree->print(options == "--stats", rendered);
+        page = rendered.str();
+        results.store(key, root->generation, page);
     }
+    output() << page << flush;
+}
 
-    libTree->printAll(categoryNode); // print all books in the category
+// function to display cache and filter statistics
+void LCMS::stats() {
+    ReadGuard lock(catalogLock);
+    ostringstream report; // the formatting flags of output() are shared by all threads
+    unsigned long lookups = results.hitCount() + results.missCount();
+    report << "result cache: " << results.size() << " entries, "
+        << results.hitCount() << " hits, " << results.missCount() << " misses";
+    if (lookups > 0) report << " (" << (100 * results.hitCount() / lookups) << "% hit rate)";
+    report << endl;
+
+    // observed rate: among the probes for keys we do not hold, the share the filter let through
+    unsigned long absent = titleMisses + titleFalsePositives;
+    report << "title filter: " << titleFilter.size() << " keys, " << titleProbes << " probes, "
+        << titleMisses << " rejected, false positive rate " << fixed << setprecision(4)
+        << (absent ? (double)titleFalsePositives / absent : 0.0)
+        << " (estimated " << titleFilter.estimatedFalsePositiveRate() << ")" << endl;
+    absent = isbnMisses + isbnFalsePositives;
+    report << "isbn filter: " << isbnFilter.size() << " keys, " << isbnProbes << " probes, "
+        << isbnMisses << " rejected, false positive rate "
+        << (absent ? (double)isbnFalsePositives / absent : 0.0)
+        << " (estimated " << isbnFilter.estimatedFalsePositiveRate() << ")" << endl;
+    {
+        lock_guard<mutex> ledger(ledgerGuard);
+        report << "loans: " << loans.size() << " open, " << loans.heapSize() << " due-date heap entries" << endl;
+    }
+    if (wal) {
+        report << "write-ahead log: " << wal->recordCount() << " records, " << wal->syncCount()
+            << " syncs (sync " << WriteAheadLog::policyName(wal->syncPolicy()) << ")" << endl;
+    }
+    {
+        lock_guard<mutex> feeds(feedGuard);
+        for (int i = 0; i < followers.size(); i++) {
+            report << "following " << followers[i]->file() << ": " << followers[i]->imported() << " records imported, up to byte "
+                << followers[i]->position() << (followers[i]->failed() ? ", stopped: the file was truncated or replaced" : "") << endl;
+        }
+    }
+    output() << report.str() << flush;
 }
 
 // function to find a specific book by title
 void LCMS::findBook(string bookTitle) {
-    Book* book = libTree->findBook(libTree->getRoot(), bookTitle);
+    ReadGuard lock(catalogLock);
+    Book* book = lookupBook(bookTitle);
+    if (book) {
+        output() << "book found in the library:\n";
+        book->display(output()); // display the book details
+    }
+    else {
+        output() << "book not found!" << endl;
+    }
+}
+
+// function to find a specific book by isbn
+void LCMS::findIsbn(string isbn) {
+    ReadGuard lock(catalogLock);
+    KeyHash isbnKey = hashKey(isbn);
+    isbnProbes++;
+    Book* book = nullptr;
+    if (!isbnFilter.mayContain(isbnKey)) {
+        isbnMisses++; // definitely not in the catalog, skip the tree walk
+    }
+    else {
+        book = libTree->findBookByIsbn(libTree->getRoot(), isbn, isbnKey);
+        if (!book) isbnFalsePositives++;
+    }
+
     if (book) {
-        cout << "book found in the library:\n";
-        book->display(); // display the book details
+        output() << "book found in the library:\n";
+        book->display(output()); // display the book details
     }
     else {
-        cout << "book not found!" << endl;
+        output() << "book not found!" << endl;
     }
 }
 
@@ -237,9 +854,14 @@ void LCMS::addBook() {
         return; // return if conversion fails
     }
 
+    addBook(title, author, isbn, publication_year, category, total_copies, available_copies);
+}
+
+// function to add a new book with all its details given
+void LCMS::addBook(string title, string author, string isbn, int publication_year, string category, int total_copies, int available_copies) {
     // check if available copies exceed total copies
     if (available_copies > total_copies) {
-        cout << "available copies cannot exceed total copies." << endl;
+        output() << "available copies cannot exceed total copies." << endl;
         return; // return if available copies are more than total copies
     }
 
@@ -247,25 +869,20 @@ void LCMS::addBook() {
     Book* newBook = new Book(title, author, isbn, publication_year, total_copies, available_copies);
 
     // create or get the category node
+    DurableChange change(wal);
+    WriteGuard lock(catalogLock);
     Node* categoryNode = libTree->createNode(category);
     if (!categoryNode) {
-        cout << "failed to create/find category node." << endl;
+        output() << "failed to create/find category node." << endl;
         delete newBook; // delete the book if category node creation fails
         return;
     }
 
-    // add the book to the category
-    categoryNode->books.push_back(newBook);
-    categoryNode->bookCount++; // increment the book count
+    attachBook(categoryNode, newBook); // add the book to the category
+    change.record(logRecord({ "book", title, author, isbn, to_string(publication_year), category,
+        to_string(total_copies), to_string(available_copies) }));
 
-    // update book count in parent nodes
-    Node* current = categoryNode->parent;
-    while (current != nullptr) {
-        current->bookCount++;
-        current = current->parent;
-    }
-
-    cout << title << " has been successfully added into the catalog." << endl;
+    output() << title << " has been successfully added into the catalog." << endl;
 }
 
 // helper function to get a valid integer from user
@@ -287,10 +904,12 @@ int getValidInteger(const string& prompt) {
 
 // function to edit a book's details
 void LCMS::editBook(string bookTitle) {
-    Book* book = libTree->findBook(libTree->getRoot(), bookTitle);
-    if (!book) {
-        cout << "book not found!" << endl;
-        return; // return if book not found
+    {
+        ReadGuard lock(catalogLock); // not held while the user types
+        if (!lookupBook(bookTitle)) {
+            cout << "book not found!" << endl;
+            return; // return if book not found
+        }
     }
 
     int choice;
@@ -307,50 +926,105 @@ void LCMS::editBook(string bookTitle) {
             << "enter your choice: ";
         choice = getValidInteger("");
 
+        string value;
         switch (choice) {
         case 1:
             cout << "enter new title: ";
-            getline(cin, book->title); // edit the title
+            getline(cin, value);
             break;
         case 2:
             cout << "enter new author: ";
-            getline(cin, book->author); // edit the author
+            getline(cin, value);
             break;
         case 3:
             cout << "enter new isbn: ";
-            getline(cin, book->isbn); // edit the isbn
+            getline(cin, value);
             break;
         case 4:
-            book->publication_year = getValidInteger("enter new publication year: "); // edit the publication year
+            value = to_string(getValidInteger("enter new publication year: "));
             break;
         case 5:
-            book->total_copies = getValidInteger("enter new total copies: "); // edit the total copies
+            value = to_string(getValidInteger("enter new total copies: "));
             break;
         case 6:
-            book->available_copies = getValidInteger("enter new available copies: "); // edit the available copies
+            value = to_string(getValidInteger("enter new available copies: "));
             break;
         case 7:
             cout << "exiting edit..." << endl;
             return; // exit the edit menu
         default:
-            cout << "invalid choice, please try again." << endl;
-            break;
+            break; // reported by editBook below
         }
-        cout << "book details updated successfully!" << endl;
+
+        if (!editBook(bookTitle, choice, value)) return; // removed in the meantime
+        if (choice == 1) bookTitle = value; // the next edit finds it by its new title
     }
 }
 
-// function to borrow a book
-void LCMS::borrowBook(string bookTitle) {
-    Book* book = libTree->findBook(libTree->getRoot(), bookTitle);
+// function to set one field of a book
+bool LCMS::editBook(string bookTitle, int field, string value) {
+    DurableChange change(wal);
+    WriteGuard lock(catalogLock);
+    Book* book = lookupBook(bookTitle);
     if (!book) {
-        cout << "book not found in the catalog." << endl;
-        return; // return if book not found
+        output() << "book not found!" << endl;
+        return false; // return if book not found
     }
 
-    if (book->available_copies <= 0) {
-        cout << "no available copies of " << bookTitle << " at the moment." << endl;
-        return; // return if no copies are available
+    int number = 0;
+    if (field >= 4 && field <= 6) {
+        istringstream stream(value);
+        if (!(stream >> number) || !stream.eof()) {
+            output() << "invalid input. please enter a valid integer." << endl;
+            return true;
+        }
+    }
+
+    NodeStats before = Tree::bookStats(book); // to propagate copy count edits
+    switch (field) {
+    case 1:
+        book->title = value; // edit the title
+        book->rehash();
+        titleFilter.insert(book->titleKey);
+        keysRemoved(1); // the old title is still in the filter
+        break;
+    case 2:
+        book->author = value; // edit the author
+        break;
+    case 3:
+        journal.recordDelete(*book, libTree->getCategory(libTree->nodeAt(book->category))); // exported rows are keyed by isbn
+        book->isbn = value; // edit the isbn
+        book->rehash();
+        isbnFilter.insert(book->isbnKey);
+        keysRemoved(1); // the old isbn is still in the filter
+        break;
+    case 4:
+        book->publication_year = number; // edit the publication year
+        break;
+    case 5:
+        book->total_copies = number; // edit the total copies
+        break;
+    case 6:
+        book->available_copies = number; // edit the available copies
+        break;
+    default:
+        output() << "invalid choice, please try again." << endl;
+        return true;
+    }
+    NodeStats delta = Tree::bookStats(book);
+    delta.add(before, -1);
+    libTree->propagate(libTree->nodeAt(book->category), delta);
+    journal.record(field == 3 ? CHANGE_INSERT : CHANGE_UPDATE, *book);
+    change.record(logRecord({ "edit", bookTitle, to_string(field), value }));
+    output() << "book details updated successfully!" << endl;
+    return true;
+}
+
+// function to borrow a book
+void LCMS::borrowBook(string bookTitle) {
+    {
+        ReadGuard lock(catalogLock); // checked again once the borrower is known
+        if (!findAvailable(bookTitle)) return;
     }
 
     string borrowerName, borrowerId;
@@ -359,55 +1033,72 @@ void LCMS::borrowBook(string bookTitle) {
     cout << "enter borrower's id: ";
     getline(cin, borrowerId); // get borrower's id
 
-    // check if borrower already exists
-    Borrower* borrower = nullptr;
-    for (int i = 0; i < borrowers.size(); i++) {
-        if (borrowers[i]->id == borrowerId) {
-            borrower = borrowers[i];
-            break;
-        }
-    }
-    if (!borrower) {
-        // create new borrower
-        borrower = new Borrower(borrowerName, borrowerId);
-        borrowers.push_back(borrower);
-    }
+    borrowBook(bookTitle, borrowerName, borrowerId);
+}
 
-    // check if borrower has already borrowed the book
-    for (int i = 0; i < book->currentBorrowers.size(); i++) {
-        if (book->currentBorrowers[i]->id == borrowerId) {
-            cout << "this borrower has already borrowed this book." << endl;
-            return;
-        }
+// function to lend a book to a given borrower
+void LCMS::borrowBook(string bookTitle, string borrowerName, string borrowerId, int64_t when) {
+    DurableChange change(wal);
+    ReadGuard lock(catalogLock); // checkouts of other books go on in parallel
+    Book* book = findAvailable(bookTitle);
+    if (!book) return;
+
+    lock_guard<mutex> bookGuard(bookLock(book));
+    if (book->available_copies <= 0) {
+        output() << "no available copies of " << bookTitle << " at the moment." << endl;
+        return; // the last copy went while we waited
     }
 
-    // add to current borrowers
-    book->currentBorrowers.push_back(borrower);
+    // find the borrower or create a new one
+    Borrower* borrower = registerBorrower(borrowerName, borrowerId);
 
-    // avoid duplicates in allBorrowers
-    bool alreadyBorrowed = false;
-    for (int i = 0; i < book->allBorrowers.size(); i++) {
-        if (book->allBorrowers[i]->id == borrowerId) {
-            alreadyBorrowed = true;
-            break;
-        }
+    // add to current borrowers unless the borrower already has the book
+    if (!book->currentBorrowers.insert(borrower)) {
+        output() << "this borrower has already borrowed this book." << endl;
+        return;
     }
-    if (!alreadyBorrowed) {
-        book->allBorrowers.push_back(borrower);
+
+    bool firstTime;
+    int64_t now = when ? when : time(nullptr);
+    int64_t due = now + (int64_t)LOAN_PERIOD_DAYS * 24 * 60 * 60;
+    {
+        lock_guard<mutex> ledger(ledgerGuard);
+        firstTime = !circulation.hasBorrowed(book->id, borrower->number);
+        circulation.append(book->id, borrower->number, EVENT_BORROW, now); // record the checkout
+        loans.openLoan(book->id, borrower->number, due);
     }
+    if (firstTime) book->borrowerCount++;
 
     // decrement available copies
     book->available_copies--;
 
-    cout << "book " << bookTitle << " has been issued to " << borrowerName << endl;
+    NodeStats delta;
+    delta.availableCopies = -1;
+    delta.loaned = 1;
+    delta.borrowerTitles = firstTime ? 1 : 0;
+    {
+        lock_guard<mutex> aggregates(statsGuard);
+        libTree->bookBorrowed(book); // update the popularity rankings
+        libTree->propagate(libTree->nodeAt(book->category), delta);
+    }
+    {
+        lock_guard<mutex> changes(journalGuard);
+        journal.record(CHANGE_UPDATE, *book); // available copies
+    }
+    change.record(logRecord({ "borrow", bookTitle, borrowerName, borrowerId, to_string(now) }));
+
+    output() << "book " << bookTitle << " has been issued to " << borrowerName
+        << ", due back on " << formatDate(due) << endl;
 }
 
 // function to return a book
 void LCMS::returnBook(string title) {
-    Book* book = libTree->findBook(libTree->getRoot(), title);
-    if (!book) {
-        cout << "book not found in the catalog." << endl;
-        return; // return if book not found
+    {
+        ReadGuard lock(catalogLock);
+        if (!lookupBook(title)) {
+            cout << "book not found in the catalog." << endl;
+            return; // return if book not found
+        }
     }
 
     string borrowerName, borrowerId;
@@ -416,214 +1107,617 @@ void LCMS::returnBook(string title) {
     cout << "enter borrower's id: ";
     getline(cin, borrowerId); // get borrower's id
 
-    bool found = false;
-    for (int i = 0; i < book->currentBorrowers.size(); i++) {
-        if (book->currentBorrowers[i]->id == borrowerId) {
-            book->currentBorrowers.erase(i); // remove borrower from current borrowers
-            book->available_copies++; // increment available copies
-            found = true;
-            break;
-        }
+    returnBook(title, borrowerName, borrowerId);
+}
+
+// function to take a book back from a given borrower
+void LCMS::returnBook(string title, string borrowerName, string borrowerId, int64_t when) {
+    DurableChange change(wal);
+    ReadGuard lock(catalogLock); // returns of other books go on in parallel
+    Book* book = lookupBook(title);
+    if (!book) {
+        output() << "book not found in the catalog." << endl;
+        return; // return if book not found
     }
 
-    if (found) {
-        cout << "book has been successfully returned." << endl;
+    lock_guard<mutex> bookGuard(bookLock(book));
+    Borrower* borrower = findBorrower(borrowerId);
+    if (borrower && book->currentBorrowers.remove(borrower)) {
+        int64_t now = when ? when : time(nullptr);
+        book->available_copies++; // increment available copies
+
+        NodeStats delta;
+        delta.availableCopies = 1;
+        delta.loaned = -1;
+        {
+            lock_guard<mutex> aggregates(statsGuard);
+            libTree->propagate(libTree->nodeAt(book->category), delta);
+        }
+        {
+            lock_guard<mutex> changes(journalGuard);
+            journal.record(CHANGE_UPDATE, *book); // available copies
+        }
+        {
+            lock_guard<mutex> ledger(ledgerGuard);
+            circulation.append(book->id, borrower->number, EVENT_RETURN, now); // record the return
+            loans.closeLoan(book->id, borrower->number);
+        }
+        change.record(logRecord({ "return", title, borrowerName, borrowerId, to_string(now) }));
+        output() << "book has been successfully returned." << endl;
     }
     else {
-        cout << "this borrower has not borrowed this book." << endl;
+        output() << "this borrower has not borrowed this book." << endl;
     }
 }
 
 // function to list current borrowers of a book
 void LCMS::listCurrentBorrowers(string bookTitle) {
-    Book* book = libTree->findBook(libTree->getRoot(), bookTitle);
+    ReadGuard lock(catalogLock);
+    Book* book = lookupBook(bookTitle);
     if (!book) {
-        cout << "book not found in the catalog." << endl;
+        output() << "book not found in the catalog." << endl;
         return; // return if book not found
     }
 
+    lock_guard<mutex> bookGuard(bookLock(book));
     if (book->currentBorrowers.size() == 0) {
-        cout << "no current borrowers for this book." << endl;
+        output() << "no current borrowers for this book." << endl;
         return; // return if no current borrowers
     }
 
-    cout << "current borrowers of " << bookTitle << ":" << endl;
-    for (int i = 0; i < book->currentBorrowers.size(); i++) {
-        cout << i + 1 << ". " << book->currentBorrowers[i]->name
-            << " (" << book->currentBorrowers[i]->id << ")" << endl; // display borrower info
+    output() << "current borrowers of " << bookTitle << ":" << endl;
+    int number = 0;
+    for (int i = 0; i < book->currentBorrowers.capacity(); i++) {
+        Borrower* borrower = book->currentBorrowers.at(i);
+        if (!borrower) continue; // empty slot
+        output() << ++number << ". " << borrower->name
+            << " (" << borrower->id << ")" << endl; // display borrower info
     }
 }
 
 // function to list all borrowers of a book
 void LCMS::listAllBorrowers(string bookTitle) {
-    Book* book = libTree->findBook(libTree->getRoot(), bookTitle);
+    ReadGuard lock(catalogLock);
+    Book* book = lookupBook(bookTitle);
     if (!book) {
-        cout << "book not found in the catalog." << endl;
+        output() << "book not found in the catalog." << endl;
         return;
     }
 
-    if (book->allBorrowers.size() == 0) {
-        cout << "no borrowers have ever borrowed this book." << endl;
+    // the book's chain runs newest first, the listing is in first-borrow order
+    lock_guard<mutex> ledger(ledgerGuard);
+    MyVector<uint32_t> newestFirst;
+    for (uint32_t r = circulation.latestForBook(book->id); r != NO_RECORD; r = circulation.at(r).prevForBook) {
+        if (circulation.at(r).event == EVENT_BORROW) newestFirst.push_back(circulation.at(r).borrowerId);
+    }
+
+    if (newestFirst.size() == 0) {
+        output() << "no borrowers have ever borrowed this book." << endl;
         return;
     }
 
-    cout << "all borrowers of " << bookTitle << ":" << endl;
-    for (int i = 0; i < book->allBorrowers.size(); i++) {
-        cout << i + 1 << ". " << book->allBorrowers[i]->name << " (" << book->allBorrowers[i]->id << ")" << endl;
+    output() << "all borrowers of " << bookTitle << ":" << endl;
+    unordered_set<uint32_t> listed;
+    int number = 0;
+    for (int i = newestFirst.size() - 1; i >= 0; i--) {
+        if (!listed.insert(newestFirst[i]).second) continue; // listed already
+        Borrower* borrower = borrowerAt(newestFirst[i]);
+        output() << ++number << ". " << borrower->name << " (" << borrower->id << ")" << endl;
     }
 }
 
 // function to list all books borrowed by a user
 void LCMS::listBooks(string borrower_name_id) {
+    string name, id;
+    if (!borrowerArgument(borrower_name_id, name, id)) return;
+    MyVector<BorrowedBook> books;
+    borrowedBooks(id, books);
+    printBorrowedBooks(name, id, books, output());
+}
+
+// function to split a "name,id" argument
+bool LCMS::borrowerArgument(const string& borrower_name_id, string& name, string& id) {
     size_t commaPos = borrower_name_id.find(',');
     if (commaPos == string::npos) {
-        cout << "invalid input format. use: name,id" << endl;
-        return; // return if input format is invalid
+        output() << "invalid input format. use: name,id" << endl;
+        return false; // return if input format is invalid
+    }
+    name = borrower_name_id.substr(0, commaPos);
+    id = borrower_name_id.substr(commaPos + 1);
+    return true;
+}
+
+// function to collect the books a borrower has borrowed
+void LCMS::borrowedBooks(const string& borrowerId, MyVector<BorrowedBook>& books) {
+    ReadGuard lock(catalogLock);
+    lock_guard<mutex> ledger(ledgerGuard);
+    Borrower* borrower = findBorrower(borrowerId);
+    if (!borrower) return;
+
+    // walk the borrower's chain in the circulation log, oldest borrow first
+    MyVector<uint32_t> newestFirst;
+    for (uint32_t r = circulation.latestForBorrower(borrower->number); r != NO_RECORD; r = circulation.at(r).prevForBorrower) {
+        if (circulation.at(r).event == EVENT_BORROW) newestFirst.push_back(r);
+    }
+
+    unordered_set<uint32_t> listed;
+    for (int i = newestFirst.size() - 1; i >= 0; i--) {
+        const CirculationRecord& record = circulation.at(newestFirst[i]);
+        Book* book = libTree->bookAt(record.bookId);
+        if (!book || !listed.insert(record.bookId).second) continue; // removed or listed already
+        BorrowedBook entry;
+        entry.title = book->title;
+        entry.sequence = record.sequence;
+        books.push_back(entry);
+    }
+}
+
+// function to print the books a borrower has borrowed
+void LCMS::printBorrowedBooks(const string& name, const string& id, const MyVector<BorrowedBook>& books, ostream& out) {
+    out << "books borrowed by " << name << " (" << id << "):" << endl;
+    for (int i = 0; i < books.size(); i++) {
+        out << "- " << books[i].title << endl;
     }
+    if (books.size() == 0) {
+        out << "no borrowing history found for this user." << endl;
+    }
+}
 
-    string name = borrower_name_id.substr(0, commaPos);
-    string id = borrower_name_id.substr(commaPos + 1);
+// function to list the circulation history of a book
+void LCMS::bookHistory(string bookTitle) {
+    ReadGuard lock(catalogLock);
+    Book* book = lookupBook(bookTitle);
+    if (!book) {
+        output() << "book not found in the catalog." << endl;
+        return;
+    }
 
-    cout << "books borrowed by " << name << " (" << id << "):" << endl;
-    int bookCount = 0;
+    lock_guard<mutex> ledger(ledgerGuard);
+    MyVector<uint32_t> newestFirst;
+    for (uint32_t r = circulation.latestForBook(book->id); r != NO_RECORD; r = circulation.at(r).prevForBook) {
+        newestFirst.push_back(r);
+    }
 
-    Node* current = libTree->getRoot();
-    if (!current) {
-        cout << "no books in the catalog." << endl;
-        return; // return if root node is null
+    if (newestFirst.size() == 0) {
+        output() << "no circulation history for this book." << endl;
+        return;
+    }
+
+    int borrows = 0;
+    output() << "circulation history of " << bookTitle << ":" << endl;
+    for (int i = newestFirst.size() - 1; i >= 0; i--) {
+        const CirculationRecord& record = circulation.at(newestFirst[i]);
+        time_t when = (time_t)record.timestamp;
+        struct tm local;
+        char stamp[32];
+        strftime(stamp, sizeof(stamp), "%Y-%m-%d %H:%M:%S", localtime_r(&when, &local)); // readers run concurrently
+
+        Borrower* borrower = borrowerAt(record.borrowerId);
+        output() << stamp << "  " << (record.event == EVENT_BORROW ? "borrowed by " : "returned by ")
+            << borrower->name << " (" << borrower->id << ")" << endl;
+        if (record.event == EVENT_BORROW) borrows++;
     }
+    output() << "borrowed " << borrows << " times." << endl;
+}
+
+// mktime re-reads TZ on every call and readers run overdue concurrently; glibc
+// locks that internally, out of ThreadSanitizer's sight, other C libraries may not
+static mutex timeZoneGuard;
+
+// function to list overdue loans
+void LCMS::overdue(string asOf) {
+    int64_t when;
+    if (!overdueArgument(asOf, when)) return;
+    MyVector<OverdueLoan> late;
+    overdueLoans(when, late);
+    printOverdue(when, late, output());
+}
 
-    // use a helper function to traverse the tree
-    bookCount = listAllBooksHelper(current, id);
+// function to parse the date of overdue
+bool LCMS::overdueArgument(const string& asOf, int64_t& when) {
+    when = time(nullptr);
+    if (asOf.empty()) return true;
 
-    if (bookCount == 0) {
-        cout << "no borrowing history found for this user." << endl;
+    int year, month, day;
+    char extra;
+    if (sscanf(asOf.c_str(), "%d-%d-%d%c", &year, &month, &day, &extra) != 3) {
+        output() << "invalid date. use: YYYY-MM-DD" << endl;
+        return false;
+    }
+    struct tm date = tm();
+    date.tm_year = year - 1900;
+    date.tm_mon = month - 1;
+    date.tm_mday = day;
+    date.tm_isdst = -1;
+    {
+        lock_guard<mutex> zone(timeZoneGuard);
+        when = mktime(&date); // start of that day, local time
+    }
+    // mktime moves a day that does not exist (2024-02-31, 2024-13-01) into the next month or year
+    if (when == -1 || date.tm_year != year - 1900 || date.tm_mon != month - 1 || date.tm_mday != day) {
+        output() << "invalid date. use: YYYY-MM-DD" << endl;
+        return false;
     }
+    return true;
 }
 
-// helper function to list all books borrowed by a user
-int LCMS::listAllBooksHelper(Node* node, const string& borrowerId) {
-    if (!node) return 0;
+// function to collect the loans overdue at a time
+void LCMS::overdueLoans(int64_t when, MyVector<OverdueLoan>& late) {
+    ReadGuard lock(catalogLock);
+    lock_guard<mutex> ledger(ledgerGuard);
+    MyVector<LoanEntry> entries;
+    loans.overdue(when, entries);
+
+    for (int i = 0; i < entries.size(); i++) {
+        Book* book = libTree->bookAt(entries[i].bookId);
+        if (!book) continue; // the book has been removed since
+        Borrower* borrower = borrowerAt(entries[i].borrowerId);
+        OverdueLoan loan;
+        loan.title = book->title;
+        loan.borrowerName = borrower->name;
+        loan.borrowerId = borrower->id;
+        loan.due = entries[i].due;
+        late.push_back(loan);
+    }
+}
 
-    int count = 0;
+// function to print overdue loans
+void LCMS::printOverdue(int64_t when, const MyVector<OverdueLoan>& late, ostream& out) {
+    if (late.size() == 0) {
+        out << "no overdue loans." << endl;
+        return;
+    }
+    out << "overdue loans as of " << formatDate(when) << ":" << endl;
+    for (int i = 0; i < late.size(); i++) {
+        out << i + 1 << ". " << late[i].title << " - " << late[i].borrowerName << " (" << late[i].borrowerId << ")"
+            << ", due " << formatDate(late[i].due)
+            << ", " << (when - late[i].due) / (24 * 60 * 60) << " days overdue" << endl;
+    }
+}
 
-    // check each book in the current node
-    for (int i = 0; i < node->books.size(); i++) {
-        Book* book = node->books[i];
-        for (int j = 0; j < book->allBorrowers.size(); j++) {
-            if (book->allBorrowers[j]->id == borrowerId) {
-                cout << "- " << book->title << endl;
-                count++;
-                break;
-            }
-        }
+// function to list the most borrowed books of a category
+void LCMS::topBooks(string count_category) {
+    int count;
+    string category;
+    if (!rankingArgument(count_category, count, category)) return;
+
+    string name;
+    MyVector<RankedBook> ranked;
+    if (!ranking(category, name, ranked)) {
+        output() << "category not found: " << category << endl;
+        return;
+    }
+    printRanking(name, ranked, count, output());
+}
+
+// function to parse the arguments of topBooks
+bool LCMS::rankingArgument(const string& count_category, int& count, string& category) {
+    stringstream sstr(count_category);
+    if (!(sstr >> count) || count <= 0) {
+        output() << "invalid input format. use: topBooks <count> [category]" << endl;
+        return false;
     }
+    category.clear();
+    getline(sstr >> ws, category);
+    return true;
+}
 
-    // check each child node
-    for (int i = 0; i < node->children.size(); i++) {
-        count += listAllBooksHelper(node->children[i], borrowerId);
+// function to collect the ranking of a category
+bool LCMS::ranking(const string& categoryPath, string& name, MyVector<RankedBook>& ranked) {
+    ReadGuard lock(catalogLock);
+    Node* node = libTree->getNode(categoryPath); // the root for an empty path
+    if (!node) return false;
+    name = categoryPath.empty() ? node->name : categoryPath;
+
+    lock_guard<mutex> aggregates(statsGuard);
+    for (uint32_t i = 0; i < node->topCount; i++) {
+        Book* book = libTree->bookAt(node->topBooks[i]);
+        RankedBook entry;
+        entry.title = book->title;
+        entry.borrows = book->borrowCount;
+        ranked.push_back(entry);
+    }
+    return true;
+}
+
+// function to print a ranking
+void LCMS::printRanking(const string& name, const MyVector<RankedBook>& ranked, int count, ostream& out) {
+    if (count > TOP_BOOKS) {
+        out << "only the top " << TOP_BOOKS << " books are ranked." << endl;
+        count = TOP_BOOKS;
+    }
+    if (ranked.size() == 0) {
+        out << "no books have been borrowed in " << name << "." << endl;
+        return;
     }
+    out << "most borrowed books in " << name << ":" << endl;
+    for (int i = 0; i < ranked.size() && i < count; i++) {
+        out << i + 1 << ". " << ranked[i].title << " (" << ranked[i].borrows << " borrows)" << endl;
+    }
+}
 
-    return count;
+// function to format a time as YYYY-MM-DD
+string LCMS::formatDate(int64_t when) {
+    time_t t = (time_t)when;
+    struct tm local;
+    char date[16];
+    strftime(date, sizeof(date), "%Y-%m-%d", localtime_r(&t, &local));
+    return date;
 }
 
 // function to remove a book from the catalog
 void LCMS::removeBook(string bookTitle) {
-    bool removed = libTree->removeBook(libTree->getRoot(), bookTitle);
-    if (removed) {
-        cout << "book removed successfully." << endl;
+    DurableChange change(wal);
+    WriteGuard lock(catalogLock);
+    KeyHash titleKey = hashKey(bookTitle);
+    Book* book = libTree->findBook(libTree->getRoot(), bookTitle, titleKey);
+    if (book) {
+        dropBook(book);
+        keysRemoved(1);
+        change.record(logRecord({ "remove", bookTitle }));
+        output() << "book removed successfully." << endl;
     }
     else {
-        cout << "book not found!" << endl;
+        output() << "book not found!" << endl;
     }
 }
 
 // function to add a new category
 void LCMS::addCategory(string path) {
+    DurableChange change(wal);
+    WriteGuard lock(catalogLock);
     Node* newNode = libTree->createNode(path); // create or get the category node
     if (newNode) {
-        cout << "category " << path << " has been created successfully." << endl;
+        change.record(logRecord({ "category", path }));
+        output() << "category " << path << " has been created successfully." << endl;
     }
     else {
-        cout << "failed to create category " << path << endl;
+        output() << "failed to create category " << path << endl;
     }
 }
 
 // function to find a category
 void LCMS::findCategory(const string categoryPath) {
+    ReadGuard lock(catalogLock);
     Node* categoryNode = libTree->getNode(categoryPath);
     if (categoryNode) {
-        cout << "category found: " << categoryPath << endl;
+        output() << "category found: " << categoryPath << endl;
     }
     else {
-        cout << "category path not found." << endl;
+        output() << "category path not found." << endl;
     }
 }
 
 // function to remove a category
 void LCMS::removeCategory(string path) {
+    bool force = false; // "--force <path>" also drops the books of the category
+    if (path.compare(0, 8, "--force ") == 0) {
+        force = true;
+        path = path.substr(8);
+    }
+
+    DurableChange change(wal);
+    WriteGuard lock(catalogLock);
     Node* node = libTree->getNode(path);
     if (!node) {
-        cout << "category not found: " << path << endl;
+        output() << "category not found: " << path << endl;
         return; // return if category not found
     }
 
     if (libTree->isRoot(node)) {
-        cout << "cannot remove root category." << endl;
+        output() << "cannot remove root category." << endl;
         return; // return if attempting to remove root
     }
 
-    if (node->bookCount > 0) {
-        cout << "cannot remove category with books. remove all books first." << endl;
+    if (node->stats.titles > 0 && !force) {
+        output() << "cannot remove category with books. remove all books first." << endl;
         return; // return if category has books
     }
 
-    Node* parentNode = node->parent;
-    if (parentNode) {
-        for (int i = 0; i < parentNode->children.size(); i++) {
-            if (parentNode->children[i] == node) {
-                parentNode->children.erase(i); // remove node from parent's children
-                delete node; // delete the node
-                cout << "category " << path << " has been removed." << endl;
-                return;
-            }
-        }
+    journalSubtree(node, CHANGE_DELETE); // only with --force are there books to drop
+    closeSubtreeLoans(node); // the same as dropBook does for a single book
+    int dropped = libTree->dropSubtree(node); // unlink and free the whole subtree
+    keysRemoved(dropped);
+    change.record(logRecord({ "removeCategory", path, force ? "1" : "0" }));
+    if (dropped > 0) {
+        output() << "category " << path << " and its " << dropped << " books have been removed." << endl;
+    }
+    else {
+        output() << "category " << path << " has been removed." << endl;
     }
 }
 
 // function to edit a categorys name
 void LCMS::editCategory(string categoryPath) {
+    {
+        ReadGuard lock(catalogLock);
+        Node* categoryNode = libTree->getNode(categoryPath);
+        if (!categoryNode) {
+            cout << "category not found: " << categoryPath << endl;
+            return;
+        }
+
+        if (libTree->isRoot(categoryNode)) {
+            cout << "cannot edit the root category name." << endl;
+            return;
+        }
+    }
+
+    cout << "enter new name for the category: ";
+    string newName;
+    getline(cin, newName);
+
+    renameCategory(categoryPath, newName);
+}
+
+// function to rename a category
+void LCMS::renameCategory(string categoryPath, string newName) {
+    DurableChange change(wal);
+    WriteGuard lock(catalogLock);
     Node* categoryNode = libTree->getNode(categoryPath);
     if (!categoryNode) {
-        cout << "category not found: " << categoryPath << endl;
+        output() << "category not found: " << categoryPath << endl;
         return;
     }
 
     if (libTree->isRoot(categoryNode)) {
-        cout << "cannot edit the root category name." << endl;
+        output() << "cannot edit the root category name." << endl;
         return;
     }
 
-    cout << "enter new name for the category: ";
-    string newName;
-    getline(cin, newName);
-
     if (newName.empty()) {
-        cout << "category name cannot be empty." << endl;
+        output() << "category name cannot be empty." << endl;
         return;
     }
 
     // check if sibling categories have the same name
-    Node* parentNode = categoryNode->parent;
-    for (int i = 0; i < parentNode->children.size(); i++) {
-        if (parentNode->children[i]->name == newName) {
-            cout << "a category with this name already exists in the parent category." << endl;
-            return;
-        }
+    if (libTree->getChild(libTree->getParent(categoryNode), newName) != nullptr) {
+        output() << "a category with this name already exists in the parent category." << endl;
+        return;
     }
 
     categoryNode->name = newName; // update the category name
-    cout << "category name updated successfully." << endl;
+    libTree->touch(categoryNode); // cached listings show the old name
+    journalSubtree(categoryNode, CHANGE_UPDATE); // the category column of every row below changed
+    change.record(logRecord({ "rename", categoryPath, newName }));
+    output() << "category name updated successfully." << endl;
+}
+
+// function to journal the books of a subtree
+void LCMS::journalSubtree(Node* node, ChangeKind kind) {
+    for (uint32_t b = node->firstBook; b != NO_BOOK; b = libTree->bookAt(b)->nextBook) {
+        Book* book = libTree->bookAt(b);
+        if (kind == CHANGE_DELETE) journal.recordDelete(*book, libTree->getCategory(node));
+        else journal.record(kind, *book);
+    }
+    for (uint32_t c = node->firstChild; c != NO_NODE; c = libTree->nodeAt(c)->nextSibling) {
+        journalSubtree(libTree->nodeAt(c), kind);
+    }
+}
+
+// function to add a new book to a category, keeping the lookup filters up to date
+void LCMS::attachBook(Node* categoryNode, Book* book) {
+    libTree->addBook(categoryNode, book); // gives the book its id and updates the counts
+    journal.record(CHANGE_INSERT, *book);
+
+    titleFilter.insert(book->titleKey);
+    isbnFilter.insert(book->isbnKey);
+    if (titleFilter.full() || isbnFilter.full()) rebuildFilters(); // outgrew its size
+}
+
+// function to find a book by title, skipping the tree walk for titles the filter rules out
+Book* LCMS::lookupBook(const string& bookTitle, bool counted) {
+    KeyHash titleKey = hashKey(bookTitle);
+    if (counted) titleProbes++;
+    if (!titleFilter.mayContain(titleKey)) {
+        if (counted) titleMisses++;
+        return nullptr;
+    }
+
+    Book* book = libTree->findBook(libTree->getRoot(), bookTitle, titleKey);
+    if (!book && counted) titleFalsePositives++;
+    return book;
+}
+
+// function to find a book that has a copy on the shelf
+Book* LCMS::findAvailable(const string& bookTitle) {
+    Book* book = lookupBook(bookTitle);
+    if (!book) {
+        output() << "book not found in the catalog." << endl;
+        return nullptr; // return if book not found
+    }
+
+    if (book->available_copies <= 0) {
+        output() << "no available copies of " << bookTitle << " at the moment." << endl;
+        return nullptr; // return if no copies are available
+    }
+    return book;
+}
+
+// function to add a batch of parsed rows to the catalog
+int LCMS::insertBatch(MyVector<Book*>& books, MyVector<string>& categories) {
+    int inserted = 0;
+    if (books.size() > 0) {
+        DurableChange change(wal); // one wait for the whole batch
+        WriteGuard lock(catalogLock);
+        for (int i = 0; i < books.size(); i++) {
+            // create or get the category node
+            Node* categoryNode = libTree->createNode(categories[i]);
+            if (!categoryNode) {
+                output() << "failed to create category node for: " << categories[i] << endl;
+                delete books[i]; // delete the book if category node creation fails
+                books[i] = nullptr;
+                continue;
+            }
+
+            Book* book = books[i];
+            books[i] = nullptr; // the tree owns it from here, a failure further on must not free it again
+            attachBook(categoryNode, book); // add the book to the category
+            change.record(logRecord({ "book", book->title, book->author, book->isbn, to_string(book->publication_year),
+                categories[i], to_string(book->total_copies), to_string((int)book->available_copies) }));
+            inserted++;
+        }
+    }
+    books.clear();
+    categories.clear();
+    return inserted;
+}
+
+// function to rebuild the filters from the live books
+void LCMS::rebuildFilters() {
+    unsigned long live = 0;
+    for (int i = 0; i < libTree->bookSlots(); i++) {
+        if (libTree->bookAt(i)) live++;
+    }
+
+    // room to grow before the next rebuild
+    titleFilter.reset(2 * live);
+    isbnFilter.reset(2 * live);
+    for (int i = 0; i < libTree->bookSlots(); i++) {
+        Book* book = libTree->bookAt(i);
+        if (!book) continue;
+        titleFilter.insert(book->titleKey);
+        isbnFilter.insert(book->isbnKey);
+    }
+    staleKeys = 0;
+}
+
+// function to account for keys that left the catalog
+void LCMS::keysRemoved(unsigned long count) {
+    staleKeys += count;
+    if (staleKeys > titleFilter.size() / 4) rebuildFilters(); // stale bits raise the false positive rate
+}
+
+// function to look up a borrower by id
+Borrower* LCMS::findBorrower(const string& id) {
+    lock_guard<mutex> registry(borrowerGuard);
+    unordered_map<string, Borrower*>::iterator it = borrowerById.find(id);
+    return it == borrowerById.end() ? nullptr : it->second;
+}
+
+// function to look up a borrower by id, adding a new one if unknown
+Borrower* LCMS::registerBorrower(const string& name, const string& id) {
+    lock_guard<mutex> registry(borrowerGuard);
+    unordered_map<string, Borrower*>::iterator it = borrowerById.find(id);
+    if (it != borrowerById.end()) return it->second;
+
+    // create new borrower
+    Borrower* borrower = new Borrower(name, id);
+    borrower->number = borrowers.size();
+    borrowers.push_back(borrower);
+    borrowerById[id] = borrower;
+    return borrower;
+}
+
+// function to look up a borrower by number
+Borrower* LCMS::borrowerAt(uint32_t number) {
+    lock_guard<mutex> registry(borrowerGuard); // the vector may grow under a checkout
+    return borrowers[number];
+}
+
+// function to pick the stripe lock of a book
+mutex& LCMS::bookLock(Book* book) {
+    return bookLocks[book->id % BOOK_LOCK_STRIPES];
 }
 
 // function to split a category path into individual categories
@@ -649,3 +1743,91 @@ MyVector<string> LCMS::splitCategoryPath(const string& path) {
 
     return categories; // return the vector of categories
 }
+
+// function to replay a write-ahead log and keep logging to it
+long LCMS::openLog(const string& path, WalSync policy) {
+    if (wal) return -1; // one log per catalog
+
+    long replayed;
+    {
+        ostream discard(nullptr); // the replayed changes would print their messages again
+        OutputRedirect quiet(discard);
+        replayed = WriteAheadLog::replay(path, [this](const MyVector<string>& fields) { applyRecord(fields); });
+    }
+    if (replayed < 0) {
+        cerr << "error: unable to read write-ahead log " << path << endl;
+        return -1;
+    }
+
+    WriteAheadLog* log = new WriteAheadLog();
+    if (!log->open(path, policy)) {
+        delete log;
+        return -1;
+    }
+    wal = log; // logged from here on, the replay itself is not logged again
+    return replayed;
+}
+
+// function to mark the catalog as a read-only copy of another one
+void LCMS::setReplica(bool isCopy) {
+    replica = isCopy;
+}
+
+bool LCMS::isReplica() {
+    return replica;
+}
+
+// function to redo one change read from the write-ahead log
+void LCMS::applyRecord(const MyVector<string>& fields) {
+    const string& kind = fields[0];
+    int count = fields.size();
+    try {
+        if (kind == "book" && count == 8) {
+            addBook(fields[1], fields[2], fields[3], stoi(fields[4]), fields[5], stoi(fields[6]), stoi(fields[7]));
+        }
+        else if (kind == "edit" && count == 4) {
+            editBook(fields[1], stoi(fields[2]), fields[3]);
+        }
+        else if (kind == "remove" && count == 2) {
+            removeBook(fields[1]);
+        }
+        else if (kind == "borrow" && count == 5) {
+            borrowBook(fields[1], fields[2], fields[3], stoll(fields[4]));
+        }
+        else if (kind == "return" && count == 5) {
+            returnBook(fields[1], fields[2], fields[3], stoll(fields[4]));
+        }
+        else if (kind == "category" && count == 2) {
+            addCategory(fields[1]);
+        }
+        else if (kind == "removeCategory" && count == 3) {
+            removeCategory(fields[2] == "1" ? "--force " + fields[1] : fields[1]);
+        }
+        else if (kind == "rename" && count == 3) {
+            renameCategory(fields[1], fields[2]);
+        }
+        else if (kind == "feed" && count == 3) {
+            feedImported(fields[1], stoll(fields[2]));
+        }
+        else if ((kind == "update" && count == 8) || (kind == "drop" && count == 2)) {
+            // reimport changes name the book by id, ids come out the same on replay
+            WriteGuard lock(catalogLock);
+            Book* book = libTree->bookAt(stoul(fields[1]));
+            if (!book) throw runtime_error("no book with id " + fields[1]);
+            if (kind == "drop") {
+                dropBook(book);
+                keysRemoved(1);
+            }
+            else {
+                Book row(fields[2], fields[3], book->isbn, stoi(fields[4]), stoi(fields[6]), stoi(fields[7]));
+                updateBook(book, row, fields[5]);
+            }
+        }
+        else {
+            cerr << "warning: skipping unknown write-ahead log record: " << kind << endl;
+        }
+    }
+    catch (const exception& e) {
+        cerr << "warning: skipping bad write-ahead log record " << kind << ": " << e.what() << endl;
+    }
+}
@@ -10,17 +10,127 @@
 #define _LCMS_H
 #include <string>
 #include <sstream>
+#include <unordered_map>
+#include <atomic>
+#include <mutex>
 #include "tree.h"
 #include "myvector.h"
 #include "borrower.h"
+#include "circulation.h"
+#include "loans.h"
+#include "resultcache.h"
+#include "bloom.h"
+#include "rwlock.h"
+#include "wal.h"
+#include "journal.h"
+
+#define IMPORT_BATCH_ROWS 1024 //rows parsed before the catalog is locked to insert them
+#define IMPORT_BLOCK_BYTES (256 * 1024) //bytes the import reader hands to the parser at a time (lines run across blocks)
+#define IMPORT_RING_SLOTS 8 //blocks or batches queued between two import stages
+#define BOOK_LOCK_STRIPES 64 //locks shared out among the books for borrow/return (stripe = book id % BOOK_LOCK_STRIPES)
 
 //#include "book.h"
 
+//time one import stage spent working and waiting on the stage before or after it
+struct StageTiming
+{
+	double busyMs;
+	double waitMs;
+
+	StageTiming() : busyMs(0), waitMs(0) {}
+};
+
+//where an import spent its time (see LCMS::importRows)
+struct ImportTimings
+{
+	StageTiming read;		//reading blocks of the file
+	StageTiming parse;		//splitting and validating rows
+	StageTiming insert;		//adding batches to the tree under the write lock
+};
+
+//a book of a topBooks ranking
+struct RankedBook
+{
+	string title;
+	unsigned int borrows;	//Book::borrowCount
+};
+
+//an open loan past its due date
+struct OverdueLoan
+{
+	string title;
+	string borrowerName;
+	string borrowerId;
+	int64_t due;			//seconds since the epoch
+};
+
+//a book a borrower has borrowed, as of the first time
+struct BorrowedBook
+{
+	string title;
+	uint32_t sequence;		//CirculationRecord::sequence of the first borrow
+};
+
+//Safe for concurrent use: the public methods take catalogLock, shared for the
+//queries and exclusive for the commands that change the shape of the catalog,
+//and never while waiting for the user. The private helpers expect the caller
+//to hold it. Borrow and return only share catalogLock: they hold the stripe
+//lock of their book and take borrowerGuard, ledgerGuard, statsGuard and
+//journalGuard one at a time for the few lines that touch state other books
+//share. Queries that read that state take the same guards; the only nesting
+//among them is ledgerGuard followed by borrowerGuard.
+//
+//With a write-ahead log attached (openLog) every change that took effect is
+//appended to the log while its locks are still held, so the log order is an
+//order the changes could have run in, and the call returns once the record is
+//durable; the wait for the disk happens after the locks are released.
+class FeedFollower;
+
 class LCMS
 {
 	private:
+		RWLock catalogLock; //readers share it, writers hold it alone
+		mutex bookLocks[BOOK_LOCK_STRIPES]; //borrow/return of books in one stripe run one at a time
+		mutex borrowerGuard; //borrowers and borrowerById
+		mutex ledgerGuard; //circulation and loans
+		mutex statsGuard; //node aggregates, generations and rankings, changed by borrow/return under a shared catalogLock
+		mutex journalGuard; //journal, changed by borrow/return and read by exportData under a shared catalogLock (see ChangeJournal)
 		Tree *libTree;	//Tree of Categories and books
 		MyVector<Borrower*> borrowers; //list of borrowers that have ever borrowed a book	
+		unordered_map<string, Borrower*> borrowerById; //borrowers indexed by id
+
+		CirculationLog circulation; //every borrow and return, in order
+		LoanIndex loans; //open loans by due date
+		ChangeJournal journal; //changed books, for export --since
+		ResultCache results; //rendered output of findAll and list
+		BloomFilter titleFilter; //every title in the catalog (plus stale ones until the next rebuild)
+		BloomFilter isbnFilter; //every isbn in the catalog (plus stale ones until the next rebuild)
+		unsigned long staleKeys; //keys removed or replaced since the filters were rebuilt
+		atomic<unsigned long> titleProbes, titleMisses, titleFalsePositives; //lookups by title, those the filter rejected, and those it let through for nothing
+		atomic<unsigned long> isbnProbes, isbnMisses, isbnFalsePositives; //same for lookups by isbn (readers count them concurrently)
+
+		Borrower* findBorrower(const string& id); //borrower with a given id, nullptr if unknown (takes borrowerGuard)
+		Borrower* registerBorrower(const string& name, const string& id); //borrower with a given id, created if unknown (takes borrowerGuard)
+		Borrower* borrowerAt(uint32_t number); //borrower by number (takes borrowerGuard)
+		mutex& bookLock(Book* book); //stripe lock of a book
+		void attachBook(Node* categoryNode, Book* book); //add a new book to a category and give it an id
+		Book* lookupBook(const string& bookTitle, bool counted = true); //find a book by title, asking the title filter first (counted: add to the filter counters)
+		Book* findAvailable(const string& bookTitle); //the book if a copy can be borrowed now, prints why not otherwise
+		int insertBatch(MyVector<Book*>& books, MyVector<string>& categories); //add parsed rows under one write lock, taking the write lock itself, returns the number added
+		void rebuildFilters(); //rebuild both filters from the books in the catalog
+		void keysRemoved(unsigned long count); //some titles/isbns left the catalog, rebuild the filters if too many did
+		static string formatDate(int64_t when); //YYYY-MM-DD in local time
+		void journalSubtree(Node* node, ChangeKind kind); //journal every book of a subtree as updated or deleted
+		Book* parseRow(const string& line, string& category); //new book from a csv row, nullptr (reported) for a bad row
+		bool updateBook(Book* book, const Book& row, const string& category); //give a book the details of a row (keeping its isbn and loans), false if nothing changed
+		void dropBook(Book* book); //remove a book with its open loans, the caller calls keysRemoved
+		void closeLoans(Book* book); //close the open loans of a book that leaves the catalog
+		void closeSubtreeLoans(Node* node); //same for every book of a subtree, before Tree::dropSubtree frees them
+		WriteAheadLog* wal; //log of changes, nullptr until openLog
+		mutex feedGuard; //followers and feedOffsets, changed by the follower threads
+		MyVector<FeedFollower*> followers; //files followed by import --follow
+		unordered_map<string, long long> feedOffsets; //bytes imported of every file ever followed (kept in the log)
+		bool replica; //changes only come from the primary's log, see setReplica
 
 		// Helper method for parsing category paths
 		MyVector<string> splitCategoryPath(const string& path);
@@ -29,27 +139,60 @@ class LCMS
 		~LCMS();
 
 		int import(string path); //import books from a csv file
-		void exportData(string path); //export all books to a given file
+		int importRows(istream& rows, ImportTimings* timings = nullptr); //import csv rows (no header line) through a reader, parser and inserter thread, returns the number added or -1 after a fatal error
+		void follow(const string& path); //import a csv file and then the rows appended to it, on a thread of its own (see feed.h)
+		void unfollow(const string& path); //stop following a file
+		void feedImported(const string& path, long long offset); //a follower imported a file up to offset (logged, so that a restart resumes there)
+		int reimport(string path); //apply a new version of the catalog file: insert, update and delete by isbn, returns the rows changed or -1
+		void exportData(string path, bool parallel = false); //export all books to a given file (rows formatted on all cores if parallel)
+		void exportChanges(unsigned long checkpoint, string path); //export the rows inserted, updated or deleted since a checkpoint of an earlier export
 		void findAll(string category); //display all books of a category
 		void findBook(string bookTitle); //Find a given book and display its details
+		void findIsbn(string isbn); //Find a book by isbn and display its details
 		void addBook();	//add a book to the catalog
+		void addBook(string title, string author, string isbn, int publication_year, string category, int total_copies, int available_copies); //same, with the details given
 		void editBook(string bookTitle); //edit a book
+		bool editBook(string bookTitle, int field, string value); //set one field (1-6 as in the edit menu), false if the book is not found
 		void borrowBook(string bookTitle); //borrow a book
+		void borrowBook(string bookTitle, string borrowerName, string borrowerId, int64_t when = 0); //same, with the borrower given (when: time of the checkout, 0 for now)
 		void returnBook(string bookTitle); //return a book 
+		void returnBook(string bookTitle, string borrowerName, string borrowerId, int64_t when = 0); //same, with the borrower given (when: time of the return, 0 for now)
 		void listCurrentBorrowers(string bookTitle); //list current borrowers of a book
 		void listAllBorrowers(string bookTitle); // list all borrowers that have ever borrowed a book
 		void listBooks(string borrower_name_id); // display books a borrower has ever borrowed
+		void bookHistory(string bookTitle); // display every borrow/return of a book with its time
+		void overdue(string asOf); // list loans that are overdue at a date (YYYY-MM-DD, empty for now)
+		void topBooks(string count_category); // list the most borrowed books of the catalog or a category
 		void removeBook(string bookTitle);//remove a book from the catalog
 		void addCategory(string category); //add a category in the catalog
 		void findCategory(string category); //find a category in the catalog
 		void removeCategory(string category); //remove a category from the catalog
 		void editCategory(string category); //edit a category from the catalog
-		void list()				   //display the catalog in tree format by calling the print method of the libTree
-		{
-			libTree->print();
-		}
+		void renameCategory(string category, string newName); //same, with the new name given
+		void list(string options="");  //display the catalog in tree format by calling the print method of the libTree ("--stats" adds the aggregates)
+		void stats(); //display cache, filter and write-ahead log statistics
+		long openLog(const string& path, WalSync policy); //replay a write-ahead log and log every change to it from now on, returns the records replayed or -1
+		void applyRecord(const MyVector<string>& fields); //redo one logged change (log replay and replicas)
+		void setReplica(bool replica); //a replica refuses changes from its own commands (see refuseChange in commands.h)
+		bool isReplica();
+		int releaseIdleBooks(); //remove the books that were never borrowed (they went to a catalog image), returns how many
+		SnapshotRef catalogSnapshot(const string& categoryPath); //point-in-time copy of a category, nullptr if not found (takes catalogLock)
+		bool hasCategory(const string& categoryPath); //true if the category exists
+		bool locateBook(const string& bookTitle, string& category); //category path of the book findBook would show, false if there is none
+		bool locateIsbn(const string& isbn, string& category); //same for findIsbn
 
-		int listAllBooksHelper(Node* node, const string& borrowerId); 
+		// structured results of list, topBooks, overdue and listBooks, which a
+		// catalog split across several LCMS merges and prints with the printers below
+		void categoryListing(CategoryListing& listing); //the categories of the catalog with their aggregates
+		bool ranking(const string& categoryPath, string& name, MyVector<RankedBook>& ranked); //most borrowed books of a category, most borrowed first; false if not found
+		void overdueLoans(int64_t when, MyVector<OverdueLoan>& late); //loans overdue at a time, earliest due first
+		void borrowedBooks(const string& borrowerId, MyVector<BorrowedBook>& books); //books a borrower has borrowed, in the order of the first borrow
+		static bool rankingArgument(const string& count_category, int& count, string& category); //parse "count [category]", prints the usage if invalid
+		static bool overdueArgument(const string& asOf, int64_t& when); //parse YYYY-MM-DD (now if empty), prints the usage if invalid
+		static bool borrowerArgument(const string& borrower_name_id, string& name, string& id); //parse "name,id", prints the usage if invalid
+		static void printRanking(const string& name, const MyVector<RankedBook>& ranked, int count, ostream& out);
+		static void printOverdue(int64_t when, const MyVector<OverdueLoan>& late, ostream& out);
+		static void printBorrowedBooks(const string& name, const string& id, const MyVector<BorrowedBook>& books, ostream& out);
 
 
 };
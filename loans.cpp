@@ -0,0 +1,118 @@
+#include "loans.h"
+
+#include <algorithm>
+
+using namespace std;
+
+static bool earlierDue(const LoanEntry& a, const LoanEntry& b) {
+    return a.due < b.due || (a.due == b.due && a.serial < b.serial);
+}
+
+LoanIndex::LoanIndex() : heap(), open(), nextSerial(0) {}
+
+uint64_t LoanIndex::key(uint32_t bookId, uint32_t borrowerId) {
+    return ((uint64_t)bookId << 32) | borrowerId;
+}
+
+bool LoanIndex::isOpen(const LoanEntry& entry) const {
+    unordered_map<uint64_t, LoanEntry>::const_iterator it = open.find(key(entry.bookId, entry.borrowerId));
+    return it != open.end() && it->second.serial == entry.serial;
+}
+
+void LoanIndex::siftUp(int i) {
+    while (i > 0) {
+        int parent = (i - 1) / 2;
+        if (heap[parent].due <= heap[i].due) break;
+        LoanEntry temp = heap[parent];
+        heap[parent] = heap[i];
+        heap[i] = temp;
+        i = parent;
+    }
+}
+
+void LoanIndex::siftDown(int i) {
+    int n = heap.size();
+    while (true) {
+        int smallest = i;
+        int left = 2 * i + 1, right = 2 * i + 2;
+        if (left < n && heap[left].due < heap[smallest].due) smallest = left;
+        if (right < n && heap[right].due < heap[smallest].due) smallest = right;
+        if (smallest == i) break;
+        LoanEntry temp = heap[smallest];
+        heap[smallest] = heap[i];
+        heap[i] = temp;
+        i = smallest;
+    }
+}
+
+void LoanIndex::popTop() {
+    heap[0] = heap[heap.size() - 1];
+    heap.erase(heap.size() - 1); // erasing the last element shifts nothing
+    if (!heap.empty()) siftDown(0);
+}
+
+void LoanIndex::dropStale() {
+    MyVector<LoanEntry> live;
+    for (int i = 0; i < heap.size(); i++) {
+        if (isOpen(heap[i])) live.push_back(heap[i]);
+    }
+    heap = live;
+    for (int i = heap.size() / 2 - 1; i >= 0; i--) {
+        siftDown(i); // heapify
+    }
+}
+
+void LoanIndex::openLoan(uint32_t bookId, uint32_t borrowerId, int64_t due) {
+    LoanEntry entry;
+    entry.due = due;
+    entry.bookId = bookId;
+    entry.borrowerId = borrowerId;
+    entry.serial = nextSerial++;
+
+    open[key(bookId, borrowerId)] = entry;
+    heap.push_back(entry);
+    siftUp(heap.size() - 1);
+}
+
+bool LoanIndex::closeLoan(uint32_t bookId, uint32_t borrowerId) {
+    if (open.erase(key(bookId, borrowerId)) == 0) return false;
+
+    // the heap entry stays until it surfaces, unless stale entries pile up
+    while (!heap.empty() && !isOpen(heap[0])) popTop();
+    if (heap.size() > 2 * (int)open.size() + 64) dropStale();
+    return true;
+}
+
+bool LoanIndex::dueDate(uint32_t bookId, uint32_t borrowerId, int64_t& due) const {
+    unordered_map<uint64_t, LoanEntry>::const_iterator it = open.find(key(bookId, borrowerId));
+    if (it == open.end()) return false;
+    due = it->second.due;
+    return true;
+}
+
+void LoanIndex::collect(int i, int64_t asOf, MyVector<LoanEntry>& out) const {
+    // children are never due earlier than their parent, so stop at the first
+    // entry that is not overdue
+    if (i >= heap.size() || heap[i].due >= asOf) return;
+    if (isOpen(heap[i])) out.push_back(heap[i]);
+    collect(2 * i + 1, asOf, out);
+    collect(2 * i + 2, asOf, out);
+}
+
+void LoanIndex::overdue(int64_t asOf, MyVector<LoanEntry>& out) {
+    while (!heap.empty() && !isOpen(heap[0])) popTop();
+    collect(0, asOf, out);
+
+    // the region is in heap order, report it by due date
+    if (out.size() > 1) {
+        sort(&out[0], &out[0] + out.size(), earlierDue);
+    }
+}
+
+int LoanIndex::size() const {
+    return open.size();
+}
+
+int LoanIndex::heapSize() const {
+    return heap.size();
+}
@@ -0,0 +1,53 @@
+//============================================================================
+// Name         : loans.h
+// Author       :
+// Version      : 1.0
+// Date Created :
+// Date Modified:
+// Description  : Open loans with due dates, indexed for overdue queries
+//============================================================================
+#ifndef _LOANS_H
+#define _LOANS_H
+#include<stdint.h>
+#include<unordered_map>
+#include "myvector.h"
+
+#define LOAN_PERIOD_DAYS 14		//a borrowed book is due back after this many days
+
+struct LoanEntry
+{
+	int64_t due;				//due date, seconds since the epoch
+	uint32_t bookId;			//Book::id
+	uint32_t borrowerId;		//Borrower::number
+	uint32_t serial;			//identifies the loan, a stale heap entry has an outdated serial
+};
+
+//Min-heap of loans keyed by due date. Returned loans are only dropped from
+//the open-loan map; their heap entries are discarded lazily when they reach
+//the top (or when stale entries outnumber open loans). Overdue loans form a
+//connected region at the top of the heap, so listing them visits only that
+//region: O(overdue + log n) instead of a scan of the catalog.
+class LoanIndex
+{
+	private:
+		MyVector<LoanEntry> heap;							//min-heap on due
+		std::unordered_map<uint64_t, LoanEntry> open;		//open loan of every (book, borrower) pair
+		uint32_t nextSerial;
+
+		static uint64_t key(uint32_t bookId, uint32_t borrowerId);
+		bool isOpen(const LoanEntry& entry) const;			//false for entries of returned loans
+		void siftUp(int i);
+		void siftDown(int i);
+		void popTop();
+		void dropStale();									//rebuild the heap without stale entries
+		void collect(int i, int64_t asOf, MyVector<LoanEntry>& out) const;
+	public:
+		LoanIndex();
+		void openLoan(uint32_t bookId, uint32_t borrowerId, int64_t due);	//record a new loan
+		bool closeLoan(uint32_t bookId, uint32_t borrowerId);			//the loan was returned, false if there was none
+		bool dueDate(uint32_t bookId, uint32_t borrowerId, int64_t& due) const; //due date of an open loan
+		void overdue(int64_t asOf, MyVector<LoanEntry>& out);			//open loans due before asOf, earliest first
+		int size() const;												//number of open loans
+		int heapSize() const;											//heap entries: the open loans plus stale entries not discarded yet
+};
+#endif
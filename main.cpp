@@ -11,14 +11,108 @@
 #include "tree.h"
 #include "myvector.h"
 #include "borrower.h"
+#include "commands.h"
+#include "server.h"
+#include "batch.h"
+#include "replication.h"
+#include "shards.h"
+#include "mapped.h"
+#include <memory>
 using namespace std;
 
-void listCommands();
-
-int main()
+int main(int argc, char* argv[])
 {
 	LCMS lcms("Library");
-	listCommands();
+
+	// lcms [--wal <file> [--sync always|group|none] [--replicate <socket>] | --replica-of <socket>]
+	//      [--shards <n> | --catalog <image>] [--serve <socket> [--workers <n>] | --batch <file> [--threads <n>]]
+	string walPath="", servePath="", batchPath="", shipPath="", primaryPath="", imagePath="";
+	WalSync walSync=WAL_SYNC_GROUP;
+	unsigned int workers=0, threads=0, shardCount=1;
+	for(int i=1; i<argc; i++)
+	{
+		string option=argv[i];
+		if(i+1>=argc)
+		{
+			cerr<<"error: missing value for "<<option<<endl;
+			return EXIT_FAILURE;
+		}
+		string value=argv[++i];
+		if(option=="--wal") walPath=value;
+		else if(option=="--serve") servePath=value;
+		else if(option=="--workers") workers=atoi(value.c_str());
+		else if(option=="--batch") batchPath=value;
+		else if(option=="--threads") threads=atoi(value.c_str());
+		else if(option=="--replicate") shipPath=value;
+		else if(option=="--replica-of") primaryPath=value;
+		else if(option=="--shards") shardCount=atoi(value.c_str());
+		else if(option=="--catalog") imagePath=value;
+		else if(option!="--sync" || !WriteAheadLog::parsePolicy(value,walSync))
+		{
+			cerr<<"error: invalid option: "<<option<<" "<<value<<endl;
+			return EXIT_FAILURE;
+		}
+	}
+
+	if(shipPath!="" && walPath=="")
+	{
+		cerr<<"error: --replicate ships the write-ahead log, it needs --wal"<<endl;
+		return EXIT_FAILURE;
+	}
+	if(primaryPath!="" && walPath!="")
+	{
+		cerr<<"error: a replica takes its changes from the primary's log, it can not have --wal"<<endl;
+		return EXIT_FAILURE;
+	}
+
+	if(shardCount>1 && (walPath!="" || primaryPath!=""))
+	{
+		cerr<<"error: a sharded catalog can not keep a write-ahead log or follow a primary"<<endl;
+		return EXIT_FAILURE;
+	}
+	if(imagePath!="" && (shardCount>1 || walPath!="" || primaryPath!=""))
+	{
+		cerr<<"error: a catalog image can not be sharded, keep a write-ahead log or follow a primary"<<endl;
+		return EXIT_FAILURE;
+	}
+
+	// bring the catalog back to where the log ends, then log every change
+	if(walPath!="")
+	{
+		long replayed=lcms.openLog(walPath,walSync);
+		if(replayed<0) return EXIT_FAILURE;
+		if(replayed>0) cerr<<replayed<<" changes replayed from "<<walPath<<endl;
+	}
+
+	// keep replicas of this catalog, or be one
+	LogShipper shipper;
+	if(shipPath!="" && !shipper.start(walPath,shipPath)) return EXIT_FAILURE;
+	ReplicaFeed feed(lcms);
+	if(primaryPath!="")
+	{
+		lcms.setReplica(true);
+		if(!feed.start(primaryPath)) return EXIT_FAILURE;
+	}
+
+	// commands go to the catalog, to a catalog split across shards or to a catalog image
+	CatalogTarget single(lcms);
+	unique_ptr<ShardedCatalog> sharded(shardCount>1 ? new ShardedCatalog(shardCount) : nullptr);
+	unique_ptr<MappedCatalog> mapped(imagePath!="" ? new MappedCatalog("Library") : nullptr);
+	if(mapped && !mapped->open(imagePath)) return EXIT_FAILURE;
+	CommandTarget& target=sharded ? (CommandTarget&)*sharded : mapped ? (CommandTarget&)*mapped : (CommandTarget&)single;
+	bool prompts=!sharded && !mapped;	//the commands that prompt work on a single catalog only
+
+	// answer clients instead of the terminal
+	if(servePath!="")
+	{
+		CommandServer server(target,servePath,workers);
+		return server.run();
+	}
+
+	// run a file of commands without prompts
+	if(batchPath!="") return runBatch(target,batchPath,cout,threads)<0 ? EXIT_FAILURE : EXIT_SUCCESS;
+
+	listCommands(cout);
 	do
 	{
 		string user_input="";
@@ -30,31 +124,22 @@ int main()
 			getline(cin,user_input);
 			
 			// parse user-input into command and parameter(s)
-			stringstream sstr(user_input);
-			getline(sstr,command,' ');
-			getline(sstr,parameter);
+			Command parsed=parseCommand(user_input);
+			command=parsed.name;
+			parameter=parsed.parameter;
+			bool inlineArguments=parameter.find(ARGUMENT_SEPARATOR)!=string::npos;
 	
 			
-			//add code as necessary
-			     if(command=="import") 			lcms.import(parameter); 
-			else if(command=="export")    	    lcms.exportData(parameter);
-			else if(command=="list")			lcms.list();
-			else if(command=="findAll")     	lcms.findAll(parameter);
-			else if(command=="findBook")		lcms.findBook(parameter);
-			else if(command=="addBook") 		lcms.addBook();
-			else if(command=="editBook")		lcms.editBook(parameter);
-			else if(command=="borrowBook")      lcms.borrowBook(parameter);
-			else if(command=="returnBook")      lcms.returnBook(parameter);
-			else if(command=="removeBook")      lcms.removeBook(parameter);
-			else if(command=="listCurrentBorrowers")  lcms.listCurrentBorrowers(parameter);
-			else if(command=="listAllBorrowers")  lcms.listAllBorrowers(parameter);
-			else if(command=="listBooks")       lcms.listBooks(parameter);
-			else if(command=="findCategory")    lcms.findCategory(parameter);
-			else if(command=="addCategory")    lcms.addCategory(parameter);
-			else if(command=="removeCategory")  lcms.removeCategory(parameter);
-			else if(command == "help")			listCommands();
+			//commands that prompt for their details, unless given inline
+			     if(refuseChange(lcms,parsed))	{}	//a replica only answers queries
+			else if(prompts && command=="addBook" && parameter.empty()) 	lcms.addBook();
+			else if(prompts && command=="editBook" && !inlineArguments)	lcms.editBook(parameter);
+			else if(prompts && command=="borrowBook" && !inlineArguments)	lcms.borrowBook(parameter);
+			else if(prompts && command=="returnBook" && !inlineArguments)	lcms.returnBook(parameter);
+			else if(prompts && command=="editCategory" && !inlineArguments)	lcms.editCategory(parameter);
+			else if(command == "help")			listCommands(cout);
 			else if(command == "exit")			break;
-			else 								cout<<"Invalid Command!"<<endl;
+			else if(!target.execute(parsed))	cout<<"Invalid Command!"<<endl;
 			fflush(stdin);
 		}
 		catch(exception &ex)
@@ -65,30 +150,3 @@ int main()
 
 	return EXIT_SUCCESS;
 }
-//======================================================================================
-void listCommands()
-{
-	cout<<" ===================================================================================="<<endl
-        <<" Welcome to the Library Catalog Management System!\n"<<endl
-        <<" List of available Commands:"<<endl
-		<<" import <file_name>                          : Read a Book file from a file"<<endl
-		<<" export <file_name>                          : Export Books to a file"<<endl
-		<<" findBook <title of the book>                : Search a book in the catalog"<<endl
-		<<" findAll <category/sub-category/..>          : List all books in a category/sub-category"<<endl
-		<<" addBook                                     : Add a book to the Catalog"<<endl
-		<<" editBook <title of the book>                : Edit a book detail in the catalog"<<endl
-		<<" removeBook <title of the book>              : Remove a book from the Catalog"<<endl
-		<<" borrowBook <title of the book>              : Borrow a book from the Library"<<endl
-		<<" returnBook <title of the book>              : Return a book to the Library"<<endl
-		<<" listCurrentBorrowers <title of the book>    : Print the list of Borrowers of a book"<<endl
-		<<" listAllBorrowers <title of the book>        : Print the list of all Borrowers that have every borrowed this book"<<endl
-		<<" listBooks <borrower's name, borrower's id>  : Print the list of books borrowed by a borrower"<<endl
-		<<" findCategory                                : Find a category in the catalog"<<endl
-		<<" addCategory <category/sub-category/...>     : Add a category/sub-category to the catalog"<<endl
-		<<" removeCategory <category/sub-category/...>  : Remove a category/sub-category from the catalog"<<endl
-		//<<" editCategory <category/sub-category/...>    : Edit a category/sub-category"<<endl
-		<<" list                                        : Display all categories from the catalog"<<endl
-		<<" help                                        : Display the list of available commands"<<endl
-		<<" exit                                        : Exit the Program"<<endl
-		<<" ====================================================================================\n"<<endl;	
-}
@@ -0,0 +1,743 @@
+#include "mapped.h"
+#include "output.h"
+#include <cstring>
+#include <cerrno>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+using namespace std;
+
+MappedImage::MappedImage() : base(nullptr), size(0) {}
+
+MappedImage::~MappedImage() {
+    if (base) munmap((void*)base, size);
+}
+
+uint64_t MappedImage::fingerprint(const string& key) {
+    uint64_t hash = 14695981039346656037ULL; // 64-bit FNV-1a
+    for (size_t i = 0; i < key.length(); i++) {
+        hash ^= (unsigned char)key[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+// true if a table of `count` entries of `width` bytes at `offset` lies inside the file
+static bool inside(uint64_t offset, uint64_t count, uint64_t width, uint64_t fileSize) {
+    return offset <= fileSize && count <= (fileSize - offset) / width;
+}
+
+bool MappedImage::open(const string& imagePath) {
+    int fd = ::open(imagePath.c_str(), O_RDONLY);
+    if (fd < 0) {
+        output() << "error: unable to open " << imagePath << ": " << strerror(errno) << endl;
+        return false;
+    }
+    struct stat info;
+    if (fstat(fd, &info) != 0 || info.st_size < (off_t)sizeof(ImageHeader)) {
+        output() << "error: " << imagePath << " is not a catalog image." << endl;
+        close(fd);
+        return false;
+    }
+
+    void* mapping = mmap(nullptr, info.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd); // the mapping keeps the file open
+    if (mapping == MAP_FAILED) {
+        output() << "error: unable to map " << imagePath << ": " << strerror(errno) << endl;
+        return false;
+    }
+    madvise(mapping, info.st_size, MADV_RANDOM); // lookups touch a few scattered pages
+
+    // only the header is checked up front, the tables are read when used
+    const ImageHeader* h = (const ImageHeader*)mapping;
+    uint64_t fileSize = info.st_size;
+    bool valid = memcmp(h->magic, IMAGE_MAGIC, sizeof(h->magic)) == 0 && h->version == IMAGE_VERSION
+        && h->fileSize == fileSize && h->nodeCount > 0
+        && h->indexSlots > h->bookCount && (h->indexSlots & (h->indexSlots - 1)) == 0
+        && inside(h->nodes, h->nodeCount, sizeof(ImageNode), fileSize)
+        && inside(h->books, h->bookCount, sizeof(ImageBook), fileSize)
+        && inside(h->titleIndex, h->indexSlots, sizeof(ImageSlot), fileSize)
+        && inside(h->isbnIndex, h->indexSlots, sizeof(ImageSlot), fileSize);
+    if (!valid) {
+        output() << "error: " << imagePath << " is not a catalog image or is damaged." << endl;
+        munmap(mapping, info.st_size);
+        return false;
+    }
+
+    if (base) munmap((void*)base, size);
+    base = (const char*)mapping;
+    size = info.st_size;
+    path = imagePath;
+    return true;
+}
+
+const ImageHeader& MappedImage::header() const {
+    return *(const ImageHeader*)base;
+}
+
+const ImageNode& MappedImage::node(uint32_t index) const {
+    if (index >= header().nodeCount) throw runtime_error("damaged catalog image: node out of range");
+    return ((const ImageNode*)(base + header().nodes))[index];
+}
+
+const ImageBook& MappedImage::book(uint32_t index) const {
+    if (index >= header().bookCount) throw runtime_error("damaged catalog image: book out of range");
+    return ((const ImageBook*)(base + header().books))[index];
+}
+
+string MappedImage::text(const ImageString& s) const {
+    if (!inside(s.offset, s.length, 1, size)) throw runtime_error("damaged catalog image: string out of range");
+    return string(base + s.offset, s.length);
+}
+
+uint32_t MappedImage::findKey(const string& key, bool byIsbn, const unordered_set<uint32_t>& skip) const {
+    const ImageHeader& h = header();
+    const ImageSlot* slots = (const ImageSlot*)(base + (byIsbn ? h.isbnIndex : h.titleIndex));
+    uint64_t hash = fingerprint(key);
+    uint32_t mask = h.indexSlots - 1;
+
+    // books with the same key were inserted in pre-order, so they are met in pre-order
+    for (uint32_t i = hash & mask, probes = 0; probes < h.indexSlots; i = (i + 1) & mask, probes++) {
+        if (slots[i].book == NO_BOOK) return NO_BOOK;
+        if (slots[i].hash != hash || skip.count(slots[i].book)) continue;
+        const ImageBook& b = book(slots[i].book);
+        const ImageString& s = byIsbn ? b.isbn : b.title;
+        if (s.length == key.length() && text(s) == key) return slots[i].book;
+    }
+    return NO_BOOK;
+}
+
+uint32_t MappedImage::findTitle(const string& title, const unordered_set<uint32_t>& skip) const {
+    return findKey(title, false, skip);
+}
+
+uint32_t MappedImage::findIsbn(const string& isbn, const unordered_set<uint32_t>& skip) const {
+    return findKey(isbn, true, skip);
+}
+
+BookRow MappedImage::row(uint32_t index) const {
+    const ImageBook& b = book(index);
+    BookRow r;
+    r.title = text(b.title);
+    r.author = text(b.author);
+    r.isbn = text(b.isbn);
+    r.publication_year = b.publication_year;
+    r.total_copies = b.total_copies;
+    r.available_copies = b.available_copies;
+    return r; // nothing of the image is on loan
+}
+
+const string& MappedImage::file() const {
+    return path;
+}
+
+// tables of an image while it is being built
+struct ImageBuilder
+{
+    MyVector<ImageNode> nodes;
+    MyVector<ImageBook> books;
+    string strings;         // string pool, placed at `stringsAt` in the file
+    uint64_t stringsAt;
+
+    ImageString add(const string& s) {
+        ImageString ref;
+        ref.offset = stringsAt + strings.length();
+        ref.length = s.length();
+        ref.reserved = 0;
+        strings += s;
+        return ref;
+    }
+
+    // lay out a subtree in pre-order, returns the index of its node
+    uint32_t addNode(const NodeSnapshot& snapshot, uint32_t parent) {
+        uint32_t index = nodes.size();
+        ImageNode n;
+        memset(&n, 0, sizeof(n));
+        n.name = add(snapshot.name);
+        n.parent = parent;
+        n.firstChild = NO_NODE;
+        n.nextSibling = NO_NODE;
+        n.firstBook = books.size();
+        n.bookCount = snapshot.books.size();
+        nodes.push_back(n);
+
+        for (int i = 0; i < snapshot.books.size(); i++) {
+            const BookRow& row = snapshot.books[i];
+            ImageBook b;
+            memset(&b, 0, sizeof(b));
+            b.title = add(row.title);
+            b.author = add(row.author);
+            b.isbn = add(row.isbn);
+            b.node = index;
+            b.publication_year = row.publication_year;
+            b.total_copies = row.total_copies;
+            b.available_copies = row.available_copies;
+            books.push_back(b);
+            nodes[index].titles++;
+            nodes[index].totalCopies += row.total_copies;
+            nodes[index].availableCopies += row.available_copies;
+        }
+
+        uint32_t previous = NO_NODE;
+        for (int i = 0; i < snapshot.children.size(); i++) {
+            uint32_t child = addNode(*snapshot.children[i], index);
+            if (previous == NO_NODE) nodes[index].firstChild = child;
+            else nodes[previous].nextSibling = child;
+            previous = child;
+            nodes[index].titles += nodes[child].titles;
+            nodes[index].totalCopies += nodes[child].totalCopies;
+            nodes[index].availableCopies += nodes[child].availableCopies;
+        }
+        return index;
+    }
+};
+
+// count the nodes and books of a subtree
+static void countSubtree(const NodeSnapshot& node, uint64_t& nodes, uint64_t& books) {
+    nodes++;
+    books += node.books.size();
+    for (int i = 0; i < node.children.size(); i++) countSubtree(*node.children[i], nodes, books);
+}
+
+static bool writeAll(int fd, const void* data, size_t length) {
+    const char* p = (const char*)data;
+    while (length > 0) {
+        ssize_t written = ::write(fd, p, length);
+        if (written < 0 && errno == EINTR) continue;
+        if (written <= 0) return false;
+        p += written;
+        length -= written;
+    }
+    return true;
+}
+
+long MappedImage::write(const NodeSnapshot& root, const string& imagePath) {
+    uint64_t nodeCount = 0, bookCount = 0;
+    countSubtree(root, nodeCount, bookCount);
+    if (nodeCount >= NO_NODE || bookCount >= NO_BOOK / 2) {
+        output() << "error: the catalog is too large for an image." << endl;
+        return -1;
+    }
+    uint32_t slots = 16;
+    while (slots < 2 * bookCount) slots *= 2; // at most half full
+
+    ImageHeader h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, IMAGE_MAGIC, sizeof(h.magic));
+    h.version = IMAGE_VERSION;
+    h.nodeCount = nodeCount;
+    h.bookCount = bookCount;
+    h.indexSlots = slots;
+    h.nodes = sizeof(ImageHeader);
+    h.books = h.nodes + nodeCount * sizeof(ImageNode);
+    h.titleIndex = h.books + bookCount * sizeof(ImageBook);
+    h.isbnIndex = h.titleIndex + (uint64_t)slots * sizeof(ImageSlot);
+
+    ImageBuilder builder;
+    builder.stringsAt = h.isbnIndex + (uint64_t)slots * sizeof(ImageSlot);
+    builder.nodes.resize(nodeCount);
+    builder.books.resize(bookCount);
+    builder.addNode(root, NO_NODE);
+    h.fileSize = builder.stringsAt + builder.strings.length();
+
+    // open addressing, books inserted in pre-order
+    MyVector<ImageSlot> titleIndex, isbnIndex;
+    ImageSlot empty;
+    empty.hash = 0;
+    empty.book = NO_BOOK;
+    empty.reserved = 0;
+    titleIndex.resize(slots);
+    isbnIndex.resize(slots);
+    for (uint32_t i = 0; i < slots; i++) {
+        titleIndex.push_back(empty);
+        isbnIndex.push_back(empty);
+    }
+    for (uint32_t b = 0; b < bookCount; b++) {
+        for (int index = 0; index < 2; index++) {
+            MyVector<ImageSlot>& table = index == 0 ? titleIndex : isbnIndex;
+            const ImageString& key = index == 0 ? builder.books[b].title : builder.books[b].isbn;
+            uint64_t hash = fingerprint(builder.strings.substr(key.offset - builder.stringsAt, key.length));
+            uint32_t i = hash & (slots - 1);
+            while (table[i].book != NO_BOOK) i = (i + 1) & (slots - 1);
+            table[i].hash = hash;
+            table[i].book = b;
+        }
+    }
+
+    // written beside the target and renamed over it, so a reader (or a crash)
+    // sees either the old image or the new one
+    string temporary = imagePath + ".tmp";
+    int fd = ::open(temporary.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        output() << "error: unable to open " << temporary << " for writing: " << strerror(errno) << endl;
+        return -1;
+    }
+    bool written = writeAll(fd, &h, sizeof(h))
+        && (nodeCount == 0 || writeAll(fd, &builder.nodes[0], nodeCount * sizeof(ImageNode)))
+        && (bookCount == 0 || writeAll(fd, &builder.books[0], bookCount * sizeof(ImageBook)))
+        && writeAll(fd, &titleIndex[0], (size_t)slots * sizeof(ImageSlot))
+        && writeAll(fd, &isbnIndex[0], (size_t)slots * sizeof(ImageSlot))
+        && writeAll(fd, builder.strings.data(), builder.strings.length())
+        && fsync(fd) == 0;
+    written = close(fd) == 0 && written;
+    if (!written || rename(temporary.c_str(), imagePath.c_str()) != 0) {
+        output() << "error: unable to write " << imagePath << ": " << strerror(errno) << endl;
+        unlink(temporary.c_str());
+        return -1;
+    }
+    return bookCount;
+}
+
+//======================================================================================
+// subtree of a snapshot and of another merged: the books of `first` come before
+// those of `second`, a category in both is merged, and the categories only in
+// `second` follow those of `first`. Either side may be missing.
+static SnapshotRef mergeSnapshots(const NodeSnapshot* first, const NodeSnapshot* second) {
+    if (!first && !second) return SnapshotRef();
+    shared_ptr<NodeSnapshot> merged(new NodeSnapshot());
+    merged->name = first ? first->name : second->name;
+    merged->generation = 0;
+
+    const NodeSnapshot* sides[2] = { first, second };
+    for (int s = 0; s < 2; s++) {
+        if (!sides[s]) continue;
+        for (int i = 0; i < sides[s]->books.size(); i++) merged->books.push_back(sides[s]->books[i]);
+    }
+
+    MyVector<bool> matched;
+    if (second) {
+        matched.resize(second->children.size());
+        for (int j = 0; j < second->children.size(); j++) matched.push_back(false);
+    }
+    if (first) {
+        for (int i = 0; i < first->children.size(); i++) {
+            const NodeSnapshot* other = nullptr;
+            for (int j = 0; second && j < second->children.size(); j++) {
+                if (!matched[j] && second->children[j]->name == first->children[i]->name) {
+                    other = second->children[j].get();
+                    matched[j] = true;
+                    break;
+                }
+            }
+            merged->children.push_back(mergeSnapshots(first->children[i].get(), other));
+        }
+    }
+    for (int j = 0; second && j < second->children.size(); j++) {
+        if (!matched[j]) merged->children.push_back(second->children[j]);
+    }
+    return merged;
+}
+
+// aggregates of a subtree of a snapshot
+static NodeStats snapshotStats(const NodeSnapshot& node) {
+    NodeStats stats;
+    for (int i = 0; i < node.books.size(); i++) {
+        const BookRow& row = node.books[i];
+        stats.titles++;
+        stats.totalCopies += row.total_copies;
+        stats.availableCopies += row.available_copies;
+        stats.loaned += row.onLoan;
+        stats.borrowerTitles += row.borrowers;
+    }
+    for (int i = 0; i < node.children.size(); i++) stats.add(snapshotStats(*node.children[i]), 1);
+    return stats;
+}
+
+// title a command is about, for the commands that take one
+static bool titleArgument(const Command& command, string& title) {
+    const string& name = command.name;
+    if (name == "removeBook" || name == "listCurrentBorrowers" || name == "listAllBorrowers" || name == "bookHistory") {
+        title = command.parameter;
+        return true;
+    }
+    if (name == "editBook" || name == "borrowBook" || name == "returnBook") {
+        title = splitArguments(command.parameter)[0];
+        return true;
+    }
+    return false;
+}
+
+// category a command renames or removes, "" for the other commands
+static string movedCategory(const Command& command, bool& force) {
+    force = false;
+    if (command.name == "editCategory") return splitArguments(command.parameter)[0];
+    if (command.name != "removeCategory") return "";
+    if (command.parameter.compare(0, 8, "--force ") == 0) {
+        force = true;
+        return command.parameter.substr(8);
+    }
+    return command.parameter;
+}
+
+MappedCatalog::MappedCatalog(const string& name) : image(new MappedImage()), overlay(name), changes(0) {}
+
+MappedCatalog::~MappedCatalog() {
+    if (changes > 0) {
+        WriteGuard lock(guard);
+        compactLocked(); // keep the changes made since the last compaction
+    }
+    delete image;
+}
+
+bool MappedCatalog::open(const string& path) {
+    if (access(path.c_str(), F_OK) != 0) {
+        SnapshotRef empty = overlay.catalogSnapshot(""); // just the root
+        if (MappedImage::write(*empty, path) < 0) return false;
+        output() << "created an empty catalog image in " << path << endl;
+    }
+    WriteGuard lock(guard);
+    return image->open(path);
+}
+
+uint32_t MappedCatalog::imageNode(const string& path) {
+    stringstream segments(path);
+    string segment;
+    uint32_t current = 0; // the root
+    while (getline(segments, segment, '/')) {
+        uint32_t child = image->node(current).firstChild;
+        while (child != NO_NODE && (hiddenNodes.count(child) || image->text(image->node(child).name) != segment)) {
+            child = image->node(child).nextSibling;
+        }
+        if (child == NO_NODE) return NO_NODE;
+        current = child;
+    }
+    return current;
+}
+
+string MappedCatalog::imagePath(uint32_t node) {
+    string path;
+    for (; node != 0; node = image->node(node).parent) {
+        string name = image->text(image->node(node).name);
+        path = path.empty() ? name : name + "/" + path;
+    }
+    return path;
+}
+
+uint32_t MappedCatalog::imageBook(const string& key, bool byIsbn) {
+    return byIsbn ? image->findIsbn(key, hiddenBooks) : image->findTitle(key, hiddenBooks);
+}
+
+bool MappedCatalog::needsMove(const string& title) {
+    string category;
+    return !overlay.locateBook(title, category) && imageBook(title, false) != NO_BOOK;
+}
+
+void MappedCatalog::moveBook(uint32_t book) {
+    const ImageBook& b = image->book(book);
+    {
+        ostream discard(nullptr); // the overlay's "added" message is not the command's reply
+        OutputRedirect quiet(discard);
+        overlay.addBook(image->text(b.title), image->text(b.author), image->text(b.isbn), b.publication_year,
+            imagePath(b.node), b.total_copies, b.available_copies);
+    }
+    hide(book);
+}
+
+void MappedCatalog::hide(uint32_t book) {
+    const ImageBook& b = image->book(book);
+    hiddenBooks.insert(book);
+
+    // take the book off the aggregates of its category and the ancestors
+    NodeStats gone;
+    gone.titles = 1;
+    gone.totalCopies = b.total_copies;
+    gone.availableCopies = b.available_copies;
+    for (uint32_t n = b.node; n != NO_NODE; n = image->node(n).parent) deltas[n].add(gone, 1);
+}
+
+void MappedCatalog::moveSubtree(uint32_t node) {
+    {
+        ostream discard(nullptr);
+        OutputRedirect quiet(discard);
+        overlay.addCategory(imagePath(node)); // an empty category moves too
+    }
+    const ImageNode& n = image->node(node);
+    for (uint32_t b = n.firstBook; b < n.firstBook + n.bookCount; b++) {
+        if (!hiddenBooks.count(b)) moveBook(b);
+    }
+    for (uint32_t c = n.firstChild; c != NO_NODE; c = image->node(c).nextSibling) {
+        if (!hiddenNodes.count(c)) moveSubtree(c);
+    }
+    hiddenNodes.insert(node);
+}
+
+NodeStats MappedCatalog::liveStats(uint32_t node) {
+    const ImageNode& n = image->node(node);
+    NodeStats stats;
+    stats.titles = n.titles;
+    stats.totalCopies = n.totalCopies;
+    stats.availableCopies = n.availableCopies;
+    unordered_map<uint32_t, NodeStats>::iterator moved = deltas.find(node);
+    if (moved != deltas.end()) stats.add(moved->second, -1);
+    return stats;
+}
+
+SnapshotRef MappedCatalog::imageSnapshot(uint32_t node) {
+    const ImageNode& n = image->node(node);
+    shared_ptr<NodeSnapshot> copy(new NodeSnapshot());
+    copy->name = image->text(n.name);
+    copy->generation = 0;
+    for (uint32_t b = n.firstBook; b < n.firstBook + n.bookCount; b++) {
+        if (!hiddenBooks.count(b)) copy->books.push_back(image->row(b));
+    }
+    for (uint32_t c = n.firstChild; c != NO_NODE; c = image->node(c).nextSibling) {
+        if (!hiddenNodes.count(c)) copy->children.push_back(imageSnapshot(c));
+    }
+    return copy;
+}
+
+SnapshotRef MappedCatalog::merged(const string& path) {
+    uint32_t node = imageNode(path);
+    SnapshotRef base = node == NO_NODE ? SnapshotRef() : imageSnapshot(node);
+    SnapshotRef changed = overlay.catalogSnapshot(path);
+    return mergeSnapshots(base.get(), changed.get());
+}
+
+void MappedCatalog::printTree(const string& padding, const string& pointer, uint32_t node, const NodeSnapshot* extra,
+    bool withStats, ostream& out) {
+    NodeStats stats;
+    if (node != NO_NODE) stats.add(liveStats(node), 1);
+    if (extra) stats.add(snapshotStats(*extra), 1);
+    string name = node != NO_NODE ? image->text(image->node(node).name) : extra->name;
+
+    // same layout as Tree::print_helper
+    out << padding << pointer << name << "(" << stats.titles << ")";
+    if (withStats) {
+        out << " [copies: " << stats.totalCopies
+            << ", available: " << stats.availableCopies
+            << ", on loan: " << stats.loaned
+            << ", borrower-titles: " << stats.borrowerTitles << "]";
+    }
+    out << endl;
+
+    // children of the image first, merged with the overlay's of the same name
+    MyVector<uint32_t> nodes;
+    MyVector<const NodeSnapshot*> extras;
+    MyVector<bool> matched;
+    if (extra) {
+        matched.resize(extra->children.size());
+        for (int j = 0; j < extra->children.size(); j++) matched.push_back(false);
+    }
+    if (node != NO_NODE) {
+        for (uint32_t c = image->node(node).firstChild; c != NO_NODE; c = image->node(c).nextSibling) {
+            if (hiddenNodes.count(c)) continue;
+            string childName = image->text(image->node(c).name);
+            const NodeSnapshot* other = nullptr;
+            for (int j = 0; extra && j < extra->children.size(); j++) {
+                if (!matched[j] && extra->children[j]->name == childName) {
+                    other = extra->children[j].get();
+                    matched[j] = true;
+                    break;
+                }
+            }
+            nodes.push_back(c);
+            extras.push_back(other);
+        }
+    }
+    for (int j = 0; extra && j < extra->children.size(); j++) {
+        if (matched[j]) continue;
+        nodes.push_back(NO_NODE);
+        extras.push_back(extra->children[j].get());
+    }
+
+    string childPadding = padding;
+    if (!pointer.empty()) childPadding += pointer == "|___" ? "   " : "|  "; // the root adds nothing
+    for (int i = 0; i < nodes.size(); i++) {
+        string marker = i == nodes.size() - 1 ? "|___" : "|---";
+        printTree(childPadding, marker, nodes[i], extras[i], withStats, out);
+    }
+}
+
+void MappedCatalog::findBook(const string& key, bool byIsbn) {
+    string category;
+    if (byIsbn ? overlay.locateIsbn(key, category) : overlay.locateBook(key, category)) {
+        if (byIsbn) overlay.findIsbn(key); // moved or added since the image was written
+        else overlay.findBook(key);
+        return;
+    }
+    uint32_t book = imageBook(key, byIsbn);
+    if (book == NO_BOOK) {
+        output() << "book not found!" << endl;
+        return;
+    }
+    output() << "book found in the library:\n";
+    image->row(book).display(output());
+}
+
+void MappedCatalog::list(const string& options) {
+    SnapshotRef changed = overlay.catalogSnapshot("");
+    ostringstream rendered;
+    printTree("", "", 0, changed.get(), options == "--stats", rendered);
+    output() << rendered.str() << flush;
+}
+
+void MappedCatalog::exportData(const string& parameter) {
+    bool parallel = parameter.compare(0, 11, "--parallel ") == 0;
+    string filename = parallel ? parameter.substr(11) : parameter;
+    ofstream file(filename);
+    if (!file.is_open()) {
+        output() << "error: unable to open file for writing." << endl;
+        return;
+    }
+
+    file << "Title,Author,ISBN,Publication Year,Category,Total Copies,Available Copies\n";
+    SnapshotRef view = merged("");
+    int count = parallel ? exportSnapshotParallel(*view, "", file) : exportSnapshot(*view, "", file);
+    file.close();
+
+    output() << count << " records have been fully exported to file" << endl;
+}
+
+void MappedCatalog::stats() {
+    overlay.stats();
+    const ImageHeader& h = image->header();
+    output() << "catalog image: " << image->file() << ", " << h.bookCount << " books in " << h.nodeCount
+        << " categories, " << hiddenBooks.size() << " books and " << hiddenNodes.size()
+        << " categories moved to the overlay, " << changes << " changes since the last compaction" << endl;
+}
+
+void MappedCatalog::hideCirculating(const NodeSnapshot& node, uint32_t& book) {
+    for (int i = 0; i < node.books.size(); i++, book++) {
+        if (node.books[i].borrowers > 0 || node.books[i].onLoan > 0) hide(book); // only the overlay's have borrowers
+    }
+    for (int i = 0; i < node.children.size(); i++) hideCirculating(*node.children[i], book);
+}
+
+long MappedCatalog::compactLocked() {
+    SnapshotRef changed = overlay.catalogSnapshot("");
+    SnapshotRef base = imageSnapshot(0);
+    SnapshotRef next = mergeSnapshots(base.get(), changed.get());
+
+    long written = MappedImage::write(*next, image->file());
+    if (written < 0) return -1;
+
+    MappedImage* fresh = new MappedImage();
+    if (!fresh->open(image->file())) {
+        delete fresh;
+        return -1;
+    }
+    delete image;
+    image = fresh;
+    hiddenBooks.clear();
+    hiddenNodes.clear();
+    deltas.clear();
+    changes = 0;
+
+    // books that were borrowed keep their borrowers and history in the overlay,
+    // their copy in the image is hidden; the others now live in the image only
+    overlay.releaseIdleBooks();
+    uint32_t book = 0; // the writer numbers the books in the pre-order of the snapshot
+    hideCirculating(*next, book);
+    return written;
+}
+
+long MappedCatalog::compact() {
+    WriteGuard lock(guard);
+    return compactLocked();
+}
+
+bool MappedCatalog::execute(const Command& command) {
+    const string& name = command.name;
+    const string& parameter = command.parameter;
+
+    if (name == "compact") {
+        long written = compact();
+        if (written >= 0) output() << "catalog image compacted: " << written << " books in " << image->file() << endl;
+        return true;
+    }
+
+    string title;
+    bool force;
+    string category = movedCategory(command, force);
+    bool named = titleArgument(command, title);
+    bool moving = false; // the command needs books of the image in the overlay first
+    {
+        ReadGuard lock(guard);
+        if (name == "findBook")             findBook(parameter, false);
+        else if (name == "findIsbn")        findBook(parameter, true);
+        else if (name == "findAll")
+        {
+            SnapshotRef view = merged(parameter);
+            if (view) printSnapshot(*view, output());
+            else output() << "category not found: " << parameter << endl;
+        }
+        else if (name == "list")            list(parameter);
+        else if (name == "export" && parameter.compare(0, 8, "--since ") == 0)
+        {
+            output() << "export --since needs a single catalog, a catalog image does not journal its changes." << endl;
+        }
+        else if (name == "export")          exportData(parameter);
+        else if (name == "stats")           stats();
+        else if (name == "save")
+        {
+            SnapshotRef view = merged("");
+            long written = MappedImage::write(*view, parameter);
+            if (written >= 0) output() << written << " books have been saved to " << parameter << endl;
+        }
+        else if (name == "findCategory")
+        {
+            if (imageNode(parameter) != NO_NODE || overlay.hasCategory(parameter)) output() << "category found: " << parameter << endl;
+            else output() << "category path not found." << endl;
+        }
+        else if (name == "topBooks")
+        {
+            // a category only in the image has never had a checkout
+            stringstream sstr(parameter);
+            int count = 0;
+            string path;
+            getline((sstr >> count) >> ws, path);
+            if (count > 0 && !overlay.hasCategory(path) && imageNode(path) != NO_NODE) {
+                output() << "no books have been borrowed in " << path << "." << endl;
+            }
+            else overlay.topBooks(parameter);
+        }
+        else if (name == "reimport")
+        {
+            output() << "reimport needs a single catalog, the overlay can not tell the image's books apart by isbn." << endl;
+        }
+        else if (name == "import" && (parameter.compare(0, 9, "--follow ") == 0 || parameter.compare(0, 7, "--stop ") == 0))
+        {
+            output() << "import --follow needs a single catalog, rows it imports would not count towards compaction." << endl;
+        }
+        else if (name == "import")
+        {
+            int added = overlay.import(parameter);
+            if (added > 0) changes += added;
+        }
+        else if (named ? needsMove(title) : !category.empty() && imageNode(category) != NO_NODE && imageNode(category) != 0)
+        {
+            moving = true; // under the exclusive lock, below
+        }
+        else
+        {
+            if (!executeCommand(overlay, command)) return false;
+            if (changesCatalog(command)) changes++;
+        }
+        if (!moving && changes < MAPPED_COMPACT_CHANGES) return true;
+    }
+
+    WriteGuard lock(guard);
+    if (moving) {
+        if (named && needsMove(title)) moveBook(imageBook(title, false));
+        uint32_t node = named || category.empty() ? NO_NODE : imageNode(category);
+        if (node != NO_NODE && node != 0) {
+            if (name == "removeCategory" && !force && liveStats(node).titles > 0) {
+                output() << "cannot remove category with books. remove all books first." << endl;
+                return true; // nothing is moved for a removal that is refused
+            }
+            moveSubtree(node);
+        }
+        executeCommand(overlay, command);
+        changes++;
+    }
+    if (changes >= MAPPED_COMPACT_CHANGES) {
+        long written = compactLocked();
+        if (written >= 0) output() << "catalog image compacted: " << written << " books in " << image->file() << endl;
+    }
+    return true;
+}
@@ -0,0 +1,170 @@
+//============================================================================
+// Name         : mapped.h
+// Author       :
+// Version      : 1.0
+// Date Created :
+// Date Modified:
+// Description  : Catalog image used in place through mmap, with an overlay
+//============================================================================
+#ifndef _MAPPED_H
+#define _MAPPED_H
+#include<string>
+#include<stdint.h>
+#include<unordered_set>
+#include<unordered_map>
+#include<atomic>
+#include "myvector.h"
+#include "snapshot.h"
+#include "tree.h"
+#include "lcms.h"
+#include "rwlock.h"
+#include "commands.h"
+using namespace std;
+
+#define IMAGE_MAGIC "LCMSIMG1"			//first 8 bytes of a catalog image
+#define IMAGE_VERSION 1
+#define MAPPED_COMPACT_CHANGES 100000	//changes after which the overlay is folded into a new image
+
+//On-disk layout. Every reference is an offset from the start of the file or
+//an index into a table, never a pointer, so the file is used as mapped. Nodes
+//and books are stored in pre-order; the books of a node are consecutive.
+struct ImageString
+{
+	uint64_t offset;			//from the start of the file
+	uint32_t length;
+	uint32_t reserved;
+};
+
+struct ImageNode
+{
+	ImageString name;
+	uint32_t parent;			//node index, NO_NODE for the root (index 0)
+	uint32_t firstChild;		//node index or NO_NODE
+	uint32_t nextSibling;		//node index or NO_NODE
+	uint32_t firstBook;			//book index of the first book stored in the node
+	uint32_t bookCount;			//books stored in the node
+	uint32_t reserved;
+	int64_t titles;				//books in the subtree
+	int64_t totalCopies;		//sum of total_copies in the subtree
+	int64_t availableCopies;	//sum of available_copies in the subtree
+};
+
+struct ImageBook
+{
+	ImageString title;
+	ImageString author;
+	ImageString isbn;
+	uint32_t node;				//node index of the category
+	int32_t publication_year;
+	int32_t total_copies;
+	int32_t available_copies;
+};
+
+//slot of the open-addressing title and isbn indexes
+struct ImageSlot
+{
+	uint64_t hash;
+	uint32_t book;				//book index, NO_BOOK for an empty slot
+	uint32_t reserved;
+};
+
+struct ImageHeader
+{
+	char magic[8];
+	uint32_t version;
+	uint32_t nodeCount;
+	uint32_t bookCount;
+	uint32_t indexSlots;		//slots of each index, a power of two
+	uint64_t nodes;				//offset of the node table
+	uint64_t books;				//offset of the book table
+	uint64_t titleIndex;		//offset of the title index
+	uint64_t isbnIndex;			//offset of the isbn index
+	uint64_t fileSize;
+};
+
+//A catalog image mapped read-only. Opening it only maps the file and checks
+//the header; pages are read from disk when a lookup touches them.
+class MappedImage
+{
+	private:
+		string path;
+		const char* base;		//start of the mapping
+		size_t size;
+
+		MappedImage(const MappedImage&);				//not copyable
+		MappedImage& operator=(const MappedImage&);
+		uint32_t findKey(const string& key, bool byIsbn, const unordered_set<uint32_t>& skip) const;
+
+	public:
+		MappedImage();
+		~MappedImage();
+		bool open(const string& path);			//map an image, false (reported) if it is not one
+		const ImageHeader& header() const;
+		const ImageNode& node(uint32_t index) const;
+		const ImageBook& book(uint32_t index) const;
+		string text(const ImageString& s) const;
+		uint32_t findTitle(const string& title, const unordered_set<uint32_t>& skip) const; //first book with the title in pre-order that is not in skip, NO_BOOK if none
+		uint32_t findIsbn(const string& isbn, const unordered_set<uint32_t>& skip) const;	//same by isbn
+		BookRow row(uint32_t index) const;				//what findBook and export show of a book
+		const string& file() const;
+
+		static uint64_t fingerprint(const string& key);	//stable across builds, unlike std::hash
+		//write a catalog image of a snapshot to path (through a temporary file),
+		//returns the number of books or -1 (reported)
+		static long write(const NodeSnapshot& root, const string& path);
+};
+
+//Serves the catalog of an image without loading it. Changes go to an overlay
+//LCMS: a book of the image that a command changes (or asks about its
+//borrowers) is first moved to the overlay and hidden in the image, and a
+//category of the image that is edited or removed moves with its whole
+//subtree. Queries merge the image with the overlay; a category present in
+//both shows the image's books first.
+//
+//Compaction (the compact command, every MAPPED_COMPACT_CHANGES changes and
+//closing the catalog) writes the merged catalog to a new image and maps it.
+//Books that were never borrowed then leave the overlay; the others stay in it
+//with their borrowers and history, and their copy in the new image is hidden.
+//Like export, the image holds no borrower state, and changes made since the
+//last compaction are lost if the process dies.
+class MappedCatalog : public CommandTarget
+{
+	private:
+		MappedImage* image;
+		LCMS overlay;
+		RWLock guard;							//image, hidden and deltas; exclusive to move books or compact
+		unordered_set<uint32_t> hiddenBooks;	//books of the image moved to the overlay
+		unordered_set<uint32_t> hiddenNodes;	//categories of the image moved to the overlay
+		unordered_map<uint32_t, NodeStats> deltas;	//what the hidden books take off the image's aggregates, by node
+		atomic<unsigned long> changes;			//changes since the last compaction
+
+		MappedCatalog(const MappedCatalog&);			//not copyable
+		MappedCatalog& operator=(const MappedCatalog&);
+
+		uint32_t imageNode(const string& path);			//live node of the image on a getNode style path, NO_NODE if none
+		string imagePath(uint32_t node);				//category path of a node of the image
+		uint32_t imageBook(const string& key, bool byIsbn);	//live book of the image, NO_BOOK if none
+		bool needsMove(const string& title);			//true if the title is only in the image
+		void moveBook(uint32_t book);					//copy a book to the overlay and hide it (exclusive)
+		void hide(uint32_t book);						//take a book of the image off the queries and the aggregates
+		void hideCirculating(const NodeSnapshot& node, uint32_t& book); //hide the books of a freshly written image that have borrowers (book: index of the first book of node)
+		void moveSubtree(uint32_t node);				//same for a category with everything below it (exclusive)
+		NodeStats liveStats(uint32_t node);				//aggregates of a node of the image without the hidden books
+		SnapshotRef imageSnapshot(uint32_t node);		//copy of a live subtree of the image
+		SnapshotRef merged(const string& path);			//image and overlay merged, nullptr if neither has the path
+		void printTree(const string& padding, const string& pointer, uint32_t node, const NodeSnapshot* extra,
+			bool withStats, ostream& out);				//list layout of a merged node
+		void findBook(const string& key, bool byIsbn);
+		void list(const string& options);
+		void exportData(const string& parameter);
+		void stats();
+		long compactLocked();							//write and map the merged catalog (exclusive), -1 on failure
+
+	public:
+		MappedCatalog(const string& name);		//name of the root category
+		~MappedCatalog();
+		bool open(const string& path);			//map an image, writing an empty one first if the file does not exist
+		bool execute(const Command& command);
+		long compact();							//fold the overlay into a new image, returns the books written or -1
+};
+#endif
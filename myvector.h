@@ -31,6 +31,7 @@ class MyVector
 		void insert(int index, T element); //Add an element at the index 
 		void erase(int index);			//Removes an element from the index
 		T& operator[](int index);		//return reference of the element at index
+		const T& operator[](int index) const; //return const reference of the element at index
 		T& at(int index); 				//return reference of the element at index
 		const T& front();				//Returns reference of the first element in the vector
 		const T& back();				//Returns reference of the Last element in the vector
@@ -38,6 +39,7 @@ class MyVector
 		int capacity() const;			//Return capacity of vector
 		bool empty() const; 			//Return true if the vector is empty, False otherwise
 		void shrink_to_fit();			//Reduce vector capacity to fit its size
+		void clear();					//Remove all elements, capacity is kept
 
 		void resize(int v_size); // resize vector
 		MyVector<T> operator++(int);  // postfix increment
@@ -187,6 +189,12 @@ T& MyVector<T>::operator[](int index) {
     return data[index];
 }
 //========================================
+// access element without bounds checking (const vectors)
+template <typename T>
+const T& MyVector<T>::operator[](int index) const {
+    return data[index];
+}
+//========================================
 // access element with bounds checking
 template <typename T>
 T& MyVector<T>::at(int index) {
@@ -228,6 +236,12 @@ void MyVector<T>::shrink_to_fit() {
     }
 }
 //======================================
+// remove all elements without releasing memory
+template <typename T>
+void MyVector<T>::clear() {
+    v_size = 0;
+}
+//======================================
 // resize the vector to new capacity
 template <typename T>
 void MyVector<T>::resize(int new_capacity) {
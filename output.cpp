@@ -0,0 +1,17 @@
+#include "output.h"
+
+using namespace std;
+
+static thread_local ostream* current = nullptr; // nullptr means cout
+
+ostream& output() {
+    return current ? *current : cout;
+}
+
+OutputRedirect::OutputRedirect(ostream& to) : previous(current) {
+    current = &to;
+}
+
+OutputRedirect::~OutputRedirect() {
+    current = previous;
+}
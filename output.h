@@ -0,0 +1,30 @@
+//============================================================================
+// Name         : output.h
+// Author       :
+// Version      : 1.0
+// Date Created :
+// Date Modified:
+// Description  : Per-thread destination of command output
+//============================================================================
+#ifndef _OUTPUT_H
+#define _OUTPUT_H
+#include<iostream>
+using namespace std;
+
+//Stream the results of a command go to on the calling thread: cout, unless
+//the thread redirected it. Lets the server and the batch mode run commands on
+//worker threads and collect each command's output on its own.
+ostream& output();
+
+//redirect the calling thread's output() for the lifetime of the object
+class OutputRedirect
+{
+	private:
+		ostream* previous;
+		OutputRedirect(const OutputRedirect&);				//not copyable
+		OutputRedirect& operator=(const OutputRedirect&);
+	public:
+		OutputRedirect(ostream& to);
+		~OutputRedirect();
+};
+#endif
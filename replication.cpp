@@ -0,0 +1,298 @@
+#include "replication.h"
+#include "wal.h"
+#include "output.h"
+#include <cstring>
+#include <cerrno>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <chrono>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+using namespace std;
+
+// fill a Unix socket address, false if the path does not fit
+static bool socketAddress(const string& path, sockaddr_un& address) {
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (path.empty() || path.length() >= sizeof(address.sun_path)) {
+        cerr << "error: invalid socket path: " << path << endl;
+        return false;
+    }
+    strcpy(address.sun_path, path.c_str());
+    return true;
+}
+
+LogShipper::LogShipper() : listenFd(-1), logFd(-1), worker(nullptr) {
+    wakeFds[0] = wakeFds[1] = -1;
+}
+
+LogShipper::~LogShipper() {
+    stop();
+}
+
+bool LogShipper::start(const string& log, const string& replicaSocket) {
+    logPath = log;
+    socketPath = replicaSocket;
+    sockaddr_un address;
+    if (!socketAddress(socketPath, address)) return false;
+
+    logFd = open(logPath.c_str(), O_RDONLY | O_CLOEXEC);
+    if (logFd < 0) {
+        cerr << "error: unable to read write-ahead log " << logPath << ": " << strerror(errno) << endl;
+        return false;
+    }
+    if (pipe(wakeFds) != 0) {
+        cerr << "error: unable to create wake pipe" << endl;
+        return false;
+    }
+
+    listenFd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    unlink(socketPath.c_str()); // left over from a primary that did not shut down
+    if (listenFd < 0 || bind(listenFd, (sockaddr*)&address, sizeof(address)) != 0 || listen(listenFd, 16) != 0) {
+        cerr << "error: unable to listen for replicas on " << socketPath << ": " << strerror(errno) << endl;
+        return false;
+    }
+
+    worker = new thread(&LogShipper::run, this);
+    cerr << "shipping " << logPath << " to replicas on " << socketPath << endl;
+    return true;
+}
+
+void LogShipper::stop() {
+    if (worker) {
+        char byte = 's';
+        ssize_t ignored = write(wakeFds[1], &byte, 1);
+        (void)ignored;
+        worker->join();
+        delete worker;
+        worker = nullptr;
+    }
+    for (int i = 0; i < replicas.size(); i++) close(replicas[i].fd);
+    replicas.clear();
+    if (listenFd >= 0) {
+        close(listenFd);
+        unlink(socketPath.c_str());
+        listenFd = -1;
+    }
+    if (logFd >= 0) close(logFd);
+    if (wakeFds[0] >= 0) close(wakeFds[0]);
+    if (wakeFds[1] >= 0) close(wakeFds[1]);
+    logFd = wakeFds[0] = wakeFds[1] = -1;
+}
+
+void LogShipper::run() {
+    while (true) {
+        // pollfds[0] is the wake pipe, [1] the listening socket, then one per replica
+        MyVector<pollfd> fds;
+        pollfd entry;
+        entry.events = POLLIN;
+        entry.revents = 0;
+        entry.fd = wakeFds[0];
+        fds.push_back(entry);
+        entry.fd = listenFd;
+        fds.push_back(entry);
+        for (int i = 0; i < replicas.size(); i++) {
+            entry.fd = replicas[i].fd;
+            fds.push_back(entry);
+        }
+
+        // the timeout is what picks up new records, the log is not watched
+        if (poll(&fds[0], fds.size(), REPLICATION_POLL_MS) < 0 && errno != EINTR) {
+            cerr << "error: replication poll failed: " << strerror(errno) << endl;
+            return;
+        }
+        if (fds[0].revents & POLLIN) return; // stop()
+
+        MyVector<Replica> alive;
+        for (int i = 0; i < replicas.size(); i++) {
+            Replica& replica = replicas[i];
+            bool ok = true;
+            if (fds[i + 2].revents & (POLLIN | POLLHUP | POLLERR)) ok = readHandshake(replica);
+            if (ok && replica.started) ok = ship(replica);
+            if (ok) alive.push_back(replica);
+            else close(replica.fd);
+        }
+        replicas = alive;
+        if (fds[1].revents & POLLIN) acceptReplicas();
+    }
+}
+
+void LogShipper::acceptReplicas() {
+    while (true) {
+        int fd = accept4(listenFd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) return; // EAGAIN: nobody else is waiting
+        Replica replica;
+        replica.fd = fd;
+        replica.started = false;
+        replica.offset = 0;
+        replica.recordEnd = 0;
+        replicas.push_back(replica);
+    }
+}
+
+bool LogShipper::readHandshake(Replica& replica) {
+    char buffer[64];
+    while (true) {
+        ssize_t received = recv(replica.fd, buffer, sizeof(buffer), 0);
+        if (received == 0) return false; // hung up
+        if (received < 0) return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+        if (replica.started) continue; // replicas only talk once
+
+        replica.handshake.append(buffer, received);
+        size_t end = replica.handshake.find('\n');
+        if (end == string::npos) {
+            if (replica.handshake.length() > 32) return false;
+            continue;
+        }
+        try {
+            replica.offset = stoll(replica.handshake.substr(0, end));
+        }
+        catch (...) {
+            return false;
+        }
+        if (replica.offset < 0) return false;
+        replica.started = true;
+    }
+}
+
+bool LogShipper::ship(Replica& replica) {
+    static char buffer[REPLICATION_CHUNK]; // only the shipper thread uses it
+    while (true) {
+        ssize_t got = pread(logFd, buffer, sizeof(buffer), replica.offset);
+        if (got <= 0) return true; // nothing new
+
+        // only whole records, a record may be half written right now
+        ssize_t end = got;
+        while (end > 0 && buffer[end - 1] != '\n') end--;
+        if (end == 0) {
+            // a record longer than the buffer goes out a buffer at a time,
+            // once all of it is on disk
+            if (got < (ssize_t)sizeof(buffer)) return true; // the last record, still being written
+            if (replica.recordEnd <= replica.offset) replica.recordEnd = findRecordEnd(replica.offset + got);
+            if (replica.recordEnd <= replica.offset) return true;
+            end = got;
+        }
+
+        ssize_t sent = send(replica.fd, buffer, end, MSG_NOSIGNAL | MSG_DONTWAIT);
+        if (sent < 0) return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+        replica.offset += sent; // may stop inside a record, the replica puts it together
+        if (sent < end) return true; // socket full, try again next round
+    }
+}
+
+long long LogShipper::findRecordEnd(long long from) {
+    static char buffer[REPLICATION_CHUNK]; // only the shipper thread uses it
+    while (true) {
+        ssize_t got = pread(logFd, buffer, sizeof(buffer), from);
+        if (got <= 0) return 0;
+        const char* found = (const char*)memchr(buffer, '\n', got);
+        if (found) return from + (found - buffer) + 1;
+        from += got;
+    }
+}
+
+ReplicaFeed::ReplicaFeed(LCMS& lcms) : lcms(lcms), worker(nullptr), stopping(false), applied(0), changes(0) {}
+
+ReplicaFeed::~ReplicaFeed() {
+    stop();
+}
+
+bool ReplicaFeed::start(const string& primarySocket) {
+    sockaddr_un address;
+    if (!socketAddress(primarySocket, address)) return false;
+    socketPath = primarySocket;
+    stopping = false;
+    worker = new thread(&ReplicaFeed::run, this);
+    return true;
+}
+
+void ReplicaFeed::stop() {
+    if (!worker) return;
+    stopping = true;
+    worker->join();
+    delete worker;
+    worker = nullptr;
+}
+
+int ReplicaFeed::connectPrimary() {
+    sockaddr_un address;
+    socketAddress(socketPath, address);
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) return -1;
+    if (connect(fd, (sockaddr*)&address, sizeof(address)) != 0) {
+        close(fd);
+        return -1;
+    }
+
+    string handshake = to_string(applied) + "\n"; // resume after the last applied record
+    if (send(fd, handshake.data(), handshake.length(), MSG_NOSIGNAL) != (ssize_t)handshake.length()) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+void ReplicaFeed::run() {
+    ostream discard(nullptr); // applied changes would print their messages
+    OutputRedirect quiet(discard);
+
+    bool reported = false; // "waiting for the primary" is said once per outage
+    while (!stopping) {
+        int fd = connectPrimary();
+        if (fd < 0) {
+            if (!reported) cerr << "replica: waiting for the primary on " << socketPath << endl;
+            reported = true;
+            pause(REPLICATION_RETRY_MS);
+            continue;
+        }
+        cerr << "replica: following " << socketPath << " from log offset " << applied << endl;
+        reported = false;
+        follow(fd);
+        close(fd);
+        if (!stopping) cerr << "replica: lost the primary after " << changes << " changes" << endl;
+    }
+}
+
+void ReplicaFeed::follow(int fd) {
+    string pending; // received, not yet a whole record
+    char buffer[REPLICATION_CHUNK];
+    while (!stopping) {
+        pollfd entry;
+        entry.fd = fd;
+        entry.events = POLLIN;
+        entry.revents = 0;
+        int ready = poll(&entry, 1, REPLICATION_POLL_MS); // wakes up now and then to see if we stop
+        if (ready < 0 && errno != EINTR) return;
+        if (ready <= 0) continue;
+
+        ssize_t received = recv(fd, buffer, sizeof(buffer), 0);
+        if (received <= 0) {
+            if (received < 0 && errno == EINTR) continue;
+            return; // primary went away
+        }
+        pending.append(buffer, received);
+
+        size_t start = 0;
+        size_t end;
+        while ((end = pending.find('\n', start)) != string::npos) {
+            MyVector<string> fields;
+            if (!WriteAheadLog::decodeRecord(pending.substr(start, end - start), fields)) {
+                cerr << "replica: damaged record at log offset " << applied << ", reconnecting" << endl;
+                return;
+            }
+            lcms.applyRecord(fields);
+            applied += end - start + 1;
+            changes++;
+            start = end + 1;
+        }
+        pending.erase(0, start);
+    }
+}
+
+void ReplicaFeed::pause(int milliseconds) {
+    for (int waited = 0; waited < milliseconds && !stopping; waited += REPLICATION_POLL_MS) {
+        this_thread::sleep_for(chrono::milliseconds(REPLICATION_POLL_MS));
+    }
+}
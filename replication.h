@@ -0,0 +1,91 @@
+//============================================================================
+// Name         : replication.h
+// Author       :
+// Version      : 1.0
+// Date Created :
+// Date Modified:
+// Description  : Read-only replicas fed from the primary's write-ahead log
+//============================================================================
+#ifndef _REPLICATION_H
+#define _REPLICATION_H
+#include<string>
+#include<thread>
+#include<atomic>
+#include "myvector.h"
+#include "lcms.h"
+using namespace std;
+
+#define REPLICATION_POLL_MS 100		//longest a new log record waits before it is shipped
+#define REPLICATION_CHUNK 65536		//log bytes read and sent at a time
+#define REPLICATION_RETRY_MS 1000	//pause before a replica connects again
+
+//Protocol: a replica connects to the primary's socket and sends, as one line,
+//the number of log bytes it has already applied (0 the first time). From that
+//offset on the primary sends its write-ahead log as it is on disk, whole
+//records only, and keeps sending new records as they are written.
+//
+//Runs on a thread of its own on the primary: it tails the log file, so the
+//commands never wait for a replica and a slow replica only falls behind.
+class LogShipper
+{
+	private:
+		struct Replica
+		{
+			int fd;
+			string handshake;	//offset line being received
+			bool started;		//handshake done, offset is valid
+			long long offset;	//log bytes sent so far
+			long long recordEnd;	//end of the record longer than REPLICATION_CHUNK being sent, 0 if none
+		};
+
+		string logPath;
+		string socketPath;
+		int listenFd;
+		int logFd;				//read side of the log file
+		int wakeFds[2];			//pipe that wakes the thread to stop
+		thread* worker;
+		MyVector<Replica> replicas;
+
+		LogShipper(const LogShipper&);				//not copyable
+		LogShipper& operator=(const LogShipper&);
+		void run();
+		void acceptReplicas();
+		bool readHandshake(Replica& replica);		//false if the replica hung up or sent garbage
+		bool ship(Replica& replica);				//send what the replica has not seen, false if it hung up
+		long long findRecordEnd(long long from);	//log offset just after the first '\n' at or after from, 0 if none is on disk yet
+
+	public:
+		LogShipper();
+		~LogShipper();
+		bool start(const string& logPath, const string& socketPath);	//listen for replicas of the log
+		void stop();
+};
+
+//Keeps a replica up to date: connects to the primary, applies every record it
+//receives with LCMS::applyRecord, and connects again (resuming at the last
+//applied record) when the primary goes away. Queries keep running on the
+//replica meanwhile; LCMS's locking orders them against the applied changes.
+class ReplicaFeed
+{
+	private:
+		LCMS& lcms;
+		string socketPath;
+		thread* worker;
+		atomic<bool> stopping;
+		long long applied;			//log bytes applied
+		unsigned long changes;		//records applied
+
+		ReplicaFeed(const ReplicaFeed&);			//not copyable
+		ReplicaFeed& operator=(const ReplicaFeed&);
+		int connectPrimary();		//connected socket or -1
+		void follow(int fd);		//apply records until the connection ends or stop()
+		void run();
+		void pause(int milliseconds);	//sleep, cut short by stop()
+
+	public:
+		ReplicaFeed(LCMS& lcms);
+		~ReplicaFeed();
+		bool start(const string& socketPath);	//follow the primary listening on socketPath
+		void stop();
+};
+#endif
@@ -0,0 +1,55 @@
+#include "resultcache.h"
+
+using namespace std;
+
+ResultCache::ResultCache() : hits(0), misses(0) {}
+
+bool ResultCache::lookup(const string& key, unsigned long generation, string& output) {
+    lock_guard<mutex> lock(guard);
+    unordered_map<string, list<Entry>::iterator>::iterator it = byKey.find(key);
+    if (it == byKey.end() || it->second->generation != generation) {
+        misses++; // unknown, or the category changed since it was rendered
+        return false;
+    }
+
+    entries.splice(entries.begin(), entries, it->second); // now most recently used
+    output = it->second->output;
+    hits++;
+    return true;
+}
+
+void ResultCache::store(const string& key, unsigned long generation, const string& output) {
+    lock_guard<mutex> lock(guard);
+    unordered_map<string, list<Entry>::iterator>::iterator it = byKey.find(key);
+    if (it != byKey.end()) {
+        entries.erase(it->second); // replace the stale entry
+        byKey.erase(it);
+    }
+
+    Entry entry;
+    entry.key = key;
+    entry.generation = generation;
+    entry.output = output;
+    entries.push_front(entry);
+    byKey[key] = entries.begin();
+
+    if ((int)entries.size() > RESULT_CACHE_ENTRIES) {
+        byKey.erase(entries.back().key); // evict the least recently used
+        entries.pop_back();
+    }
+}
+
+unsigned long ResultCache::hitCount() const {
+    lock_guard<mutex> lock(guard);
+    return hits;
+}
+
+unsigned long ResultCache::missCount() const {
+    lock_guard<mutex> lock(guard);
+    return misses;
+}
+
+int ResultCache::size() const {
+    lock_guard<mutex> lock(guard);
+    return entries.size();
+}
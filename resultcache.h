@@ -0,0 +1,47 @@
+//============================================================================
+// Name         : resultcache.h
+// Author       :
+// Version      : 1.0
+// Date Created :
+// Date Modified:
+// Description  : LRU cache of rendered command output
+//============================================================================
+#ifndef _RESULTCACHE_H
+#define _RESULTCACHE_H
+#include<string>
+#include<list>
+#include<unordered_map>
+#include<mutex>
+
+#define RESULT_CACHE_ENTRIES 64		//rendered results kept by the cache
+
+//Rendered output of read-only commands (findAll, list), keyed by command and
+//category path. Every entry remembers the generation of the category node it
+//was rendered from; Tree bumps the generation of a node and its ancestors on
+//every change below it, so a stale entry is recognized on lookup and never
+//has to be hunted down when the catalog changes.
+//Lookups reorder the entries, so the cache has its own mutex and can be used
+//by concurrent readers of the catalog.
+class ResultCache
+{
+	private:
+		struct Entry
+		{
+			std::string key;
+			unsigned long generation;	//generation of the node when rendered
+			std::string output;
+		};
+		std::list<Entry> entries;		//most recently used first
+		std::unordered_map<std::string, std::list<Entry>::iterator> byKey;
+		unsigned long hits;
+		unsigned long misses;
+		mutable std::mutex guard;		//protects everything above
+	public:
+		ResultCache();
+		bool lookup(const std::string& key, unsigned long generation, std::string& output); //true and the output if a fresh entry exists
+		void store(const std::string& key, unsigned long generation, const std::string& output);
+		unsigned long hitCount() const;
+		unsigned long missCount() const;
+		int size() const;
+};
+#endif
@@ -0,0 +1,32 @@
+#include "rwlock.h"
+#include <stdexcept>
+
+using namespace std;
+
+RWLock::RWLock() {
+    pthread_rwlockattr_t attributes;
+    pthread_rwlockattr_init(&attributes);
+#ifdef __GLIBC__
+    // the glibc default lets new readers overtake a waiting writer forever
+    pthread_rwlockattr_setkind_np(&attributes, PTHREAD_RWLOCK_PREFER_WRITER_NONRECURSIVE_NP);
+#endif
+    int status = pthread_rwlock_init(&lock, &attributes);
+    pthread_rwlockattr_destroy(&attributes);
+    if (status != 0) throw runtime_error("unable to create the catalog lock");
+}
+
+RWLock::~RWLock() {
+    pthread_rwlock_destroy(&lock);
+}
+
+void RWLock::lockRead() {
+    pthread_rwlock_rdlock(&lock);
+}
+
+void RWLock::lockWrite() {
+    pthread_rwlock_wrlock(&lock);
+}
+
+void RWLock::unlock() {
+    pthread_rwlock_unlock(&lock);
+}
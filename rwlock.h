@@ -0,0 +1,49 @@
+//============================================================================
+// Name         : rwlock.h
+// Author       :
+// Version      : 1.0
+// Date Created :
+// Date Modified:
+// Description  : Reader-writer lock guarding the catalog
+//============================================================================
+#ifndef _RWLOCK_H
+#define _RWLOCK_H
+#include<pthread.h>
+
+//Many readers or one writer. Writers are preferred where the platform allows
+//it, so a steady stream of queries can not starve a checkout. The lock is not
+//recursive: a thread holding it must not take it again.
+class RWLock
+{
+	private:
+		pthread_rwlock_t lock;
+		RWLock(const RWLock&);				//not copyable
+		RWLock& operator=(const RWLock&);
+	public:
+		RWLock();
+		~RWLock();
+		void lockRead();	//shared, for commands that only look at the catalog
+		void lockWrite();	//exclusive, for commands that change it
+		void unlock();		//release either kind
+};
+
+//holds a read lock for the lifetime of the guard
+class ReadGuard
+{
+	private:
+		RWLock& held;
+	public:
+		ReadGuard(RWLock& lock) : held(lock) { held.lockRead(); }
+		~ReadGuard() { held.unlock(); }
+};
+
+//holds a write lock for the lifetime of the guard
+class WriteGuard
+{
+	private:
+		RWLock& held;
+	public:
+		WriteGuard(RWLock& lock) : held(lock) { held.lockWrite(); }
+		~WriteGuard() { held.unlock(); }
+};
+#endif
@@ -0,0 +1,316 @@
+#include "server.h"
+#include <cstring>
+#include <cerrno>
+#include <csignal>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+using namespace std;
+
+static int signalFd = -1; // write end of the wake pipe of the running server
+static volatile sig_atomic_t stopRequested = 0;
+
+static void onSignal(int) {
+    stopRequested = 1;
+    if (signalFd >= 0) {
+        char byte = 's';
+        ssize_t ignored = write(signalFd, &byte, 1);
+        (void)ignored;
+    }
+}
+
+static bool setNonBlocking(int fd) {
+    int flags = fcntl(fd, F_GETFL, 0);
+    return flags >= 0 && fcntl(fd, F_SETFL, flags | O_NONBLOCK) == 0;
+}
+
+CommandServer::CommandServer(CommandTarget& target, const string& socketPath, unsigned int workers)
+    : target(target), socketPath(socketPath), workerCount(workers), listenFd(-1), nextClient(0), stopping(false) {
+    if (workerCount == 0) workerCount = thread::hardware_concurrency();
+    if (workerCount == 0) workerCount = 4; // unknown core count
+    wakeFds[0] = wakeFds[1] = -1;
+}
+
+CommandServer::~CommandServer() {
+    {
+        lock_guard<mutex> lock(queueGuard);
+        stopping = true;
+    }
+    jobReady.notify_all();
+    for (int i = 0; i < workers.size(); i++) {
+        workers[i]->join();
+        delete workers[i];
+    }
+
+    while (!clients.empty()) closeClient(clients.begin()->first);
+    if (listenFd >= 0) {
+        close(listenFd);
+        unlink(socketPath.c_str());
+    }
+    if (signalFd == wakeFds[1]) signalFd = -1;
+    if (wakeFds[0] >= 0) close(wakeFds[0]);
+    if (wakeFds[1] >= 0) close(wakeFds[1]);
+}
+
+bool CommandServer::listen() {
+    sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (socketPath.empty() || socketPath.length() >= sizeof(address.sun_path)) {
+        cerr << "error: invalid socket path: " << socketPath << endl;
+        return false;
+    }
+    strcpy(address.sun_path, socketPath.c_str());
+
+    listenFd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listenFd < 0) {
+        cerr << "error: unable to create socket: " << strerror(errno) << endl;
+        return false;
+    }
+    unlink(socketPath.c_str()); // left over from a server that did not shut down
+    if (bind(listenFd, (sockaddr*)&address, sizeof(address)) != 0 || ::listen(listenFd, SERVER_BACKLOG) != 0
+        || !setNonBlocking(listenFd)) {
+        cerr << "error: unable to listen on " << socketPath << ": " << strerror(errno) << endl;
+        return false;
+    }
+    return true;
+}
+
+int CommandServer::run() {
+    if (pipe(wakeFds) != 0 || !setNonBlocking(wakeFds[0]) || !setNonBlocking(wakeFds[1])) {
+        cerr << "error: unable to create wake pipe" << endl;
+        return EXIT_FAILURE;
+    }
+    if (!listen()) return EXIT_FAILURE;
+
+    // SIGPIPE would kill the server when a client hangs up mid-reply
+    signal(SIGPIPE, SIG_IGN);
+    stopRequested = 0;
+    signalFd = wakeFds[1];
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = onSignal;
+    sigaction(SIGINT, &action, nullptr);
+    sigaction(SIGTERM, &action, nullptr);
+
+    for (unsigned int i = 0; i < workerCount; i++) {
+        workers.push_back(new thread(&CommandServer::workerLoop, this));
+    }
+    cout << "serving on " << socketPath << " with " << workerCount << " workers" << endl;
+
+    while (!stopRequested) {
+        // pollfds[0] is the wake pipe, [1] the listening socket, then one per client
+        MyVector<pollfd> fds;
+        MyVector<unsigned long> owners;
+        pollfd entry;
+        entry.fd = wakeFds[0];
+        entry.events = POLLIN;
+        entry.revents = 0;
+        fds.push_back(entry);
+        entry.fd = listenFd;
+        fds.push_back(entry);
+        for (map<unsigned long, Client>::iterator it = clients.begin(); it != clients.end(); ++it) {
+            const Client& client = it->second;
+            // nothing to read from or write to until a reply comes back
+            if (client.gone || ((client.closing || client.inputClosed) && client.pending.empty())) continue;
+            entry.fd = client.fd;
+            entry.events = (client.closing || client.inputClosed) ? 0 : POLLIN;
+            if (!client.pending.empty()) entry.events |= POLLOUT;
+            fds.push_back(entry);
+            owners.push_back(it->first);
+        }
+
+        if (poll(&fds[0], fds.size(), -1) < 0) {
+            if (errno == EINTR) continue;
+            cerr << "error: poll failed: " << strerror(errno) << endl;
+            break;
+        }
+
+        if (fds[0].revents & POLLIN) {
+            char drain[64];
+            while (read(wakeFds[0], drain, sizeof(drain)) > 0) {}
+            collectReplies();
+        }
+        if (fds[1].revents & POLLIN) acceptClients();
+
+        for (int i = 2; i < fds.size(); i++) {
+            unsigned long number = owners[i - 2];
+            map<unsigned long, Client>::iterator it = clients.find(number);
+            if (it == clients.end()) continue;
+            Client& client = it->second;
+
+            bool alive = true;
+            if (fds[i].revents & (POLLIN | POLLHUP | POLLERR)) alive = readClient(client);
+            if (alive && (fds[i].revents & POLLOUT)) alive = writeClient(client);
+            if (!alive) {
+                // a client that left while a command of it runs is closed when the reply comes back
+                if (client.busy) client.gone = true;
+                else closeClient(number);
+                continue;
+            }
+
+            dispatch(number, client);
+            if (done(client)) closeClient(number);
+        }
+    }
+
+    cout << "server stopped" << endl;
+    return EXIT_SUCCESS;
+}
+
+void CommandServer::acceptClients() {
+    while (true) {
+        int fd = accept(listenFd, nullptr, nullptr);
+        if (fd < 0) return; // EAGAIN: nobody else is waiting
+        if (!setNonBlocking(fd)) {
+            close(fd);
+            continue;
+        }
+        Client client;
+        client.fd = fd;
+        client.busy = false;
+        client.closing = false;
+        client.inputClosed = false;
+        client.gone = false;
+        clients[nextClient++] = client;
+    }
+}
+
+bool CommandServer::readClient(Client& client) {
+    char buffer[SERVER_READ_CHUNK];
+    while (true) {
+        ssize_t received = recv(client.fd, buffer, sizeof(buffer), 0);
+        if (received > 0) {
+            client.input.append(buffer, received);
+            if (client.input.length() > SERVER_MAX_LINE && client.input.find('\n') == string::npos) return false;
+            continue;
+        }
+        if (received == 0) {
+            client.inputClosed = true; // replies to what was sent are still delivered
+            if (!client.input.empty() && client.input[client.input.length() - 1] != '\n') client.input += '\n';
+            return true;
+        }
+        return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+    }
+}
+
+bool CommandServer::writeClient(Client& client) {
+    while (!client.pending.empty()) {
+        ssize_t sent = send(client.fd, client.pending.data(), client.pending.length(), MSG_NOSIGNAL);
+        if (sent > 0) {
+            client.pending.erase(0, sent);
+            continue;
+        }
+        return sent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR);
+    }
+    return true;
+}
+
+void CommandServer::dispatch(unsigned long number, Client& client) {
+    if (client.busy || client.closing) return;
+
+    size_t end = client.input.find('\n');
+    if (end == string::npos) return;
+    string line = client.input.substr(0, end);
+    client.input.erase(0, end + 1);
+    if (!line.empty() && line[line.length() - 1] == '\r') line.erase(line.length() - 1); // telnet style clients
+
+    if (line == "exit") {
+        client.closing = true;
+        return;
+    }
+
+    Job job;
+    job.client = number;
+    job.line = line;
+    client.busy = true;
+    {
+        lock_guard<mutex> lock(queueGuard);
+        jobs.push_back(job);
+    }
+    jobReady.notify_one();
+}
+
+void CommandServer::workerLoop() {
+    while (true) {
+        Job job;
+        {
+            unique_lock<mutex> lock(queueGuard);
+            while (jobs.empty() && !stopping) jobReady.wait(lock);
+            if (stopping) return;
+            job = jobs.front();
+            jobs.pop_front();
+        }
+
+        job.line = encodeReply(runCommand(target, parseCommand(job.line)));
+
+        {
+            lock_guard<mutex> lock(queueGuard);
+            finished.push_back(job);
+        }
+        wake();
+    }
+}
+
+void CommandServer::wake() {
+    char byte = 'r';
+    ssize_t ignored = write(wakeFds[1], &byte, 1); // a full pipe already wakes the loop
+    (void)ignored;
+}
+
+void CommandServer::collectReplies() {
+    deque<Job> replies;
+    {
+        lock_guard<mutex> lock(queueGuard);
+        replies.swap(finished);
+    }
+
+    for (size_t i = 0; i < replies.size(); i++) {
+        map<unsigned long, Client>::iterator it = clients.find(replies[i].client);
+        if (it == clients.end()) continue;
+        Client& client = it->second;
+        client.busy = false;
+        if (client.gone) {
+            closeClient(it->first); // went away while the command ran
+            continue;
+        }
+        client.pending += replies[i].line;
+        if (!writeClient(client)) {
+            closeClient(it->first);
+            continue;
+        }
+        dispatch(it->first, client); // the next line may already be waiting
+        if (done(client)) closeClient(it->first);
+    }
+}
+
+bool CommandServer::done(const Client& client) {
+    if (client.busy || !client.pending.empty()) return false;
+    return client.closing || (client.inputClosed && client.input.find('\n') == string::npos);
+}
+
+void CommandServer::closeClient(unsigned long number) {
+    map<unsigned long, Client>::iterator it = clients.find(number);
+    if (it == clients.end()) return;
+    close(it->second.fd);
+    clients.erase(it);
+}
+
+string CommandServer::encodeReply(const string& text) {
+    string reply;
+    reply.reserve(text.length() + 8);
+    size_t start = 0;
+    while (start < text.length()) {
+        size_t end = text.find('\n', start);
+        if (end == string::npos) end = text.length();
+        if (text[start] == '.') reply += '.'; // a line of its own "." would end the reply
+        reply.append(text, start, end - start);
+        reply += '\n';
+        start = end + 1;
+    }
+    reply += ".\n";
+    return reply;
+}
@@ -0,0 +1,88 @@
+//============================================================================
+// Name         : server.h
+// Author       :
+// Version      : 1.0
+// Date Created :
+// Date Modified:
+// Description  : Multi-client command server on a Unix domain socket
+//============================================================================
+#ifndef _SERVER_H
+#define _SERVER_H
+#include<string>
+#include<map>
+#include<deque>
+#include<mutex>
+#include<condition_variable>
+#include<thread>
+#include "myvector.h"
+#include "commands.h"
+using namespace std;
+
+#define SERVER_BACKLOG 64			//connections waiting to be accepted
+#define SERVER_READ_CHUNK 4096		//bytes read from a client at a time
+#define SERVER_MAX_LINE 65536		//longest command line accepted, longer ones drop the client
+
+//Serves one catalog to many clients. A single thread polls the listening socket
+//and every client without blocking; complete lines are handed to a pool of
+//worker threads that run them with executeCommand (so every command takes
+//its arguments inline) and LCMS's own locking lets them run side by side.
+//
+//Protocol: the client sends one command per line, exactly as typed at the
+//prompt. The reply is the command's output followed by a line holding only
+//"."; output lines starting with "." are sent with an extra "." in front.
+//A client's commands run one at a time and in order. "exit" closes the
+//connection. SIGINT or SIGTERM stops the server.
+class CommandServer
+{
+	private:
+		struct Client
+		{
+			int fd;
+			string input;		//received, not yet dispatched
+			string pending;		//replies not yet sent
+			bool busy;			//a command of this client is running
+			bool closing;		//"exit" received, close once pending is sent
+			bool inputClosed;	//the client finished sending, close once its lines are answered
+			bool gone;			//the connection failed while a command of it was running
+		};
+		struct Job
+		{
+			unsigned long client;	//client the line came from
+			string line;			//command line, then its encoded reply
+		};
+
+		CommandTarget& target;
+		string socketPath;
+		unsigned int workerCount;
+		int listenFd;
+		int wakeFds[2];						//workers and signals wake the poll loop through this pipe
+		map<unsigned long, Client> clients;	//by client number, only touched by the poll loop
+		unsigned long nextClient;
+
+		mutex queueGuard;					//protects jobs, finished and stopping
+		condition_variable jobReady;
+		deque<Job> jobs;					//lines waiting for a worker
+		deque<Job> finished;				//replies waiting for the poll loop
+		bool stopping;
+		MyVector<thread*> workers;
+
+		bool listen();						//create, bind and listen on socketPath
+		void workerLoop();					//run jobs until stopping
+		void wake();						//interrupt poll()
+		void acceptClients();
+		bool readClient(Client& client);	//false if the client went away
+		bool writeClient(Client& client);	//false if the client went away
+		void dispatch(unsigned long number, Client& client); //hand the next complete line to the workers
+		void collectReplies();
+		void closeClient(unsigned long number);
+		static bool done(const Client& client);	//nothing left to run or send for the client
+		static string encodeReply(const string& text); //dot-stuff and terminate a reply
+
+		CommandServer(const CommandServer&);			//not copyable
+		CommandServer& operator=(const CommandServer&);
+	public:
+		CommandServer(CommandTarget& target, const string& socketPath, unsigned int workers = 0); //0 = one per core
+		~CommandServer();
+		int run();	//serve until stopped, returns the exit status
+};
+#endif
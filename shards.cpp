@@ -0,0 +1,433 @@
+#include "shards.h"
+#include "mapped.h"
+#include "csvscan.h"
+#include "output.h"
+#include <fstream>
+#include <sstream>
+#include <thread>
+#include <algorithm>
+
+using namespace std;
+
+// first segment of a category path; createNode skips empty segments, getNode does not
+static string topLevelOf(const string& path, bool skipEmpty) {
+    size_t start = 0;
+    if (skipEmpty) {
+        start = path.find_first_not_of('/');
+        if (start == string::npos) return "";
+    }
+    size_t end = path.find('/', start);
+    return path.substr(start, end == string::npos ? string::npos : end - start);
+}
+
+static bool moreBorrows(const RankedBook& a, const RankedBook& b) {
+    return a.borrows > b.borrows;
+}
+
+static bool dueEarlier(const OverdueLoan& a, const OverdueLoan& b) {
+    return a.due < b.due;
+}
+
+static bool borrowedEarlier(const BorrowedBook& a, const BorrowedBook& b) {
+    return a.sequence < b.sequence;
+}
+
+ShardedCatalog::ShardedCatalog(unsigned int count) : nextShard(0) {
+    if (count == 0) count = 1;
+    for (unsigned int i = 0; i < count; i++) shards.push_back(new LCMS("Library"));
+}
+
+ShardedCatalog::~ShardedCatalog() {
+    for (int i = 0; i < shards.size(); i++) delete shards[i];
+}
+
+bool ShardedCatalog::execute(const Command& command) {
+    const string& name = command.name;
+    const string& parameter = command.parameter;
+
+    if (name == "import") {
+        if (parameter.compare(0, 9, "--follow ") == 0 || parameter.compare(0, 7, "--stop ") == 0) {
+            output() << "import --follow needs a single catalog." << endl;
+        }
+        else import(parameter);
+        return true;
+    }
+    if (name == "reimport") {
+        output() << "reimport needs a single catalog, a book can move to a category of another shard." << endl;
+        return true;
+    }
+    if (name == "addBook" || name == "addCategory" || name == "removeCategory" || name == "editCategory"
+        || name == "findCategory") {
+        return categoryCommand(command, parameter);
+    }
+    if (name == "stats" || name == "overdue" || name == "listBooks") {
+        if (name == "stats") stats(command); // every shard has its own counters and loans
+        else if (name == "overdue") overdue(command);
+        else listBooks(command);
+        return true;
+    }
+
+    ReadGuard lock(placementLock);
+    if (name == "export") {
+        if (parameter.compare(0, 8, "--since ") == 0) output() << "export --since needs a single catalog, the shards number their changes apart." << endl;
+        else exportData(parameter);
+        return true;
+    }
+    if (name == "save") {
+        long written = MappedImage::write(*mergedRoot(), parameter);
+        if (written >= 0) output() << written << " books have been saved to " << parameter << endl;
+        return true;
+    }
+    if (name == "list") {
+        list(command);
+        return true;
+    }
+    if (name == "findAll") {
+        if (parameter.empty()) findAllRoot();
+        else executeCommand(*shards[shardOf(parameter)], command);
+        return true;
+    }
+    if (name == "topBooks") {
+        stringstream sstr(parameter);
+        int count;
+        string category;
+        if (sstr >> count && count > 0) getline(sstr >> ws, category);
+        else count = 0; // shard 0 prints the usage
+        if (count > 0 && category.empty()) topBooksRoot(count);
+        else executeCommand(*shards[shardOf(category)], command);
+        return true;
+    }
+
+    bool byTitle = name == "findBook" || name == "removeBook" || name == "listCurrentBorrowers"
+        || name == "listAllBorrowers" || name == "bookHistory";
+    bool inlineTitle = name == "editBook" || name == "borrowBook" || name == "returnBook";
+    if (byTitle || inlineTitle || name == "findIsbn") {
+        string key = inlineTitle ? splitArguments(parameter)[0] : parameter;
+        int shard = bookShard(key, name == "findIsbn");
+        executeCommand(*shards[shard < 0 ? 0 : shard], command); // shard 0 reports a missing book
+        return true;
+    }
+    return false;
+}
+
+int ShardedCatalog::placed(const string& name) {
+    for (int i = 0; i < topLevel.size(); i++) {
+        if (topLevel[i] == name) return i;
+    }
+    return -1;
+}
+
+int ShardedCatalog::shardOf(const string& path) {
+    int index = placed(topLevelOf(path, false));
+    return index < 0 ? 0 : owner[index];
+}
+
+int ShardedCatalog::place(const string& name) {
+    if (name.empty()) return 0; // the root
+    int index = placed(name);
+    if (index >= 0) return owner[index];
+    topLevel.push_back(name);
+    owner.push_back(nextShard);
+    nextShard = (nextShard + 1) % shards.size();
+    return owner.back();
+}
+
+void ShardedCatalog::unplaceMissing(const string& name) {
+    int index = placed(name);
+    if (index < 0 || shards[owner[index]]->hasCategory(name)) return;
+    topLevel.erase(index);
+    owner.erase(index);
+}
+
+int ShardedCatalog::bookShard(const string& key, bool byIsbn) {
+    MyVector<string> categories;
+    MyVector<int> found;
+    for (int i = 0; i < shards.size(); i++) {
+        categories.push_back("");
+        found.push_back(0);
+    }
+    scatter([&](int i) {
+        found[i] = byIsbn ? shards[i]->locateIsbn(key, categories[i]) : shards[i]->locateBook(key, categories[i]);
+    });
+
+    // a single catalog finds the book the pre-order walk reaches first:
+    // books of the root, then the top-level categories in order
+    int best = -1;
+    int bestRank = 0;
+    for (int i = 0; i < shards.size(); i++) {
+        if (!found[i]) continue;
+        int rank = categories[i].empty() ? -1 : placed(topLevelOf(categories[i], false));
+        if (best < 0 || rank < bestRank) {
+            best = i;
+            bestRank = rank;
+        }
+    }
+    return best;
+}
+
+void ShardedCatalog::scatter(const function<void(int)>& work) {
+    MyVector<thread*> workers;
+    for (int i = 1; i < shards.size(); i++) workers.push_back(new thread(work, i));
+    work(0); // the calling thread takes shard 0
+    for (int i = 0; i < workers.size(); i++) {
+        workers[i]->join();
+        delete workers[i];
+    }
+}
+
+void ShardedCatalog::scatterCommand(const Command& command, MyVector<string>& outputs) {
+    outputs.clear();
+    for (int i = 0; i < shards.size(); i++) outputs.push_back("");
+    scatter([&](int i) {
+        CatalogTarget shard(*shards[i]);
+        outputs[i] = runCommand(shard, command);
+    });
+}
+
+bool ShardedCatalog::categoryCommand(const Command& command, const string& parameter) {
+    const string& name = command.name;
+    bool creates = name == "addBook" || name == "addCategory";
+
+    string path = parameter;
+    string newName;
+    if (name == "addBook" || name == "editCategory") {
+        MyVector<string> arguments = splitArguments(parameter);
+        if (arguments.size() != (name == "addBook" ? 7 : 2)) {
+            return executeCommand(*shards[0], command); // prints the usage
+        }
+        path = name == "addBook" ? arguments[4] : arguments[0];
+        if (name == "editCategory") newName = arguments[1];
+    }
+    else if (name == "removeCategory" && path.compare(0, 8, "--force ") == 0) {
+        path = path.substr(8);
+    }
+
+    string top = topLevelOf(path, creates);
+    bool topLevelChange = creates || (path == top && (name == "removeCategory" || name == "editCategory"));
+    if (!topLevelChange) {
+        ReadGuard lock(placementLock);
+        return executeCommand(*shards[shardOf(path)], command);
+    }
+
+    WriteGuard lock(placementLock);
+    int shard = creates ? place(top) : shardOf(path);
+    if (name == "editCategory" && newName != top && placed(newName) >= 0) {
+        output() << "a category with this name already exists in the parent category." << endl; // on another shard
+        return true;
+    }
+
+    executeCommand(*shards[shard], command);
+    if (name == "editCategory") {
+        int index = placed(top);
+        if (index >= 0 && !shards[shard]->hasCategory(top) && shards[shard]->hasCategory(newName)) {
+            topLevel[index] = newName; // renamed in place, keeps its position
+        }
+    }
+    else if (!top.empty()) {
+        unplaceMissing(top); // removed, or never created because the command failed
+    }
+    return true;
+}
+
+void ShardedCatalog::import(const string& path) {
+    ifstream file(path);
+    if (!file.good()) {
+        output() << "error: file does not exist or cannot be accessed at: " << path << endl;
+        return;
+    }
+
+    // hand every row to the shard of its top-level category, new categories in file order
+    MyVector<string> parts;
+    for (int i = 0; i < shards.size(); i++) parts.push_back("");
+    {
+        WriteGuard lock(placementLock);
+        string line;
+        getline(file, line); // skip the header line
+        while (getline(file, line)) {
+            if (line.empty()) continue;
+
+            MyVector<string> fields;
+            csvSplitLine(line, fields);
+            if (fields.size() != 7) {
+                output() << "skipping line: invalid number of fields" << endl;
+                continue;
+            }
+            string category = fields[4];
+            if (category.length() >= 2 && category.front() == '"' && category.back() == '"') {
+                category = category.substr(1, category.length() - 2);
+            }
+            string& part = parts[place(topLevelOf(category, true))];
+            part += line;
+            part += '\n';
+        }
+    }
+    file.close();
+
+    MyVector<int> counts;
+    MyVector<string> outputs;
+    for (int i = 0; i < shards.size(); i++) {
+        counts.push_back(0);
+        outputs.push_back("");
+    }
+    scatter([&](int i) {
+        ostringstream text;
+        OutputRedirect redirect(text);
+        istringstream rows(parts[i]);
+        counts[i] = shards[i]->importRows(rows);
+        outputs[i] = text.str();
+    });
+
+    {
+        WriteGuard lock(placementLock);
+        MyVector<string> names = topLevel;
+        for (int i = 0; i < names.size(); i++) unplaceMissing(names[i]); // every row of it was rejected
+    }
+
+    int imported = 0;
+    bool failed = false;
+    for (int i = 0; i < shards.size(); i++) {
+        output() << outputs[i];
+        if (counts[i] < 0) failed = true;
+        else imported += counts[i];
+    }
+    if (!failed) output() << imported << " records have been imported." << endl;
+}
+
+SnapshotRef ShardedCatalog::mergedRoot() {
+    MyVector<SnapshotRef> roots;
+    for (int i = 0; i < shards.size(); i++) roots.push_back(SnapshotRef());
+    scatter([&](int i) { roots[i] = shards[i]->catalogSnapshot(""); });
+
+    shared_ptr<NodeSnapshot> merged = make_shared<NodeSnapshot>();
+    merged->name = roots[0]->name;
+    merged->generation = 0;
+    for (int i = 0; i < roots.size(); i++) {
+        for (int b = 0; b < roots[i]->books.size(); b++) merged->books.push_back(roots[i]->books[b]);
+    }
+    for (int k = 0; k < topLevel.size(); k++) {
+        const NodeSnapshot& root = *roots[owner[k]];
+        for (int c = 0; c < root.children.size(); c++) {
+            if (root.children[c]->name == topLevel[k]) {
+                merged->children.push_back(root.children[c]);
+                break;
+            }
+        }
+    }
+    return merged;
+}
+
+void ShardedCatalog::exportData(const string& parameter) {
+    bool parallel = parameter.compare(0, 11, "--parallel ") == 0;
+    ofstream file(parallel ? parameter.substr(11) : parameter);
+    if (!file.is_open()) {
+        output() << "error: unable to open file for writing." << endl;
+        return;
+    }
+
+    file << "Title,Author,ISBN,Publication Year,Category,Total Copies,Available Copies\n";
+    SnapshotRef view = mergedRoot();
+    int count = parallel ? exportSnapshotParallel(*view, "", file) : exportSnapshot(*view, "", file);
+    file.close();
+    output() << count << " records have been fully exported to file" << endl;
+}
+
+void ShardedCatalog::findAllRoot() {
+    ostringstream rendered;
+    printSnapshot(*mergedRoot(), rendered);
+    output() << rendered.str() << flush;
+}
+
+void ShardedCatalog::list(const Command& command) {
+    MyVector<CategoryListing> roots;
+    for (int i = 0; i < shards.size(); i++) roots.push_back(CategoryListing());
+    scatter([&](int i) { shards[i]->categoryListing(roots[i]); });
+
+    // the root adds up the roots of the shards, its children are the
+    // top-level categories in the order they were created
+    CategoryListing merged;
+    merged.name = roots[0].name;
+    for (int i = 0; i < roots.size(); i++) merged.stats.add(roots[i].stats, 1);
+    for (int k = 0; k < topLevel.size(); k++) {
+        const CategoryListing& root = roots[owner[k]];
+        for (int c = 0; c < root.children.size(); c++) {
+            if (root.children[c]->name == topLevel[k]) {
+                merged.children.push_back(root.children[c]);
+                break;
+            }
+        }
+    }
+
+    ostringstream page;
+    Tree::print(merged, command.parameter == "--stats", page);
+    output() << page.str() << flush;
+}
+
+void ShardedCatalog::topBooksRoot(int count) {
+    MyVector<string> names;
+    MyVector<MyVector<RankedBook> > rankings;
+    for (int i = 0; i < shards.size(); i++) {
+        names.push_back("");
+        rankings.push_back(MyVector<RankedBook>());
+    }
+    scatter([&](int i) { shards[i]->ranking("", names[i], rankings[i]); });
+
+    // every shard ranks its own books, the merged ranking keeps the shard order among equal counts
+    MyVector<RankedBook> ranked;
+    for (int i = 0; i < rankings.size(); i++) {
+        for (int j = 0; j < rankings[i].size(); j++) ranked.push_back(rankings[i][j]);
+    }
+    if (ranked.size() > 1) stable_sort(&ranked[0], &ranked[0] + ranked.size(), moreBorrows);
+
+    ostringstream page;
+    LCMS::printRanking(names[0], ranked, count, page);
+    output() << page.str() << flush;
+}
+
+void ShardedCatalog::overdue(const Command& command) {
+    int64_t when;
+    if (!LCMS::overdueArgument(command.parameter, when)) return;
+
+    MyVector<MyVector<OverdueLoan> > loans;
+    for (int i = 0; i < shards.size(); i++) loans.push_back(MyVector<OverdueLoan>());
+    scatter([&](int i) { shards[i]->overdueLoans(when, loans[i]); });
+
+    // every shard lists its loans by due date, the merge sorts on the raw due times
+    MyVector<OverdueLoan> late;
+    for (int i = 0; i < loans.size(); i++) {
+        for (int j = 0; j < loans[i].size(); j++) late.push_back(loans[i][j]);
+    }
+    if (late.size() > 1) stable_sort(&late[0], &late[0] + late.size(), dueEarlier);
+
+    ostringstream page;
+    LCMS::printOverdue(when, late, page);
+    output() << page.str() << flush;
+}
+
+void ShardedCatalog::listBooks(const Command& command) {
+    string name, id;
+    if (!LCMS::borrowerArgument(command.parameter, name, id)) return;
+
+    MyVector<MyVector<BorrowedBook> > borrowed;
+    for (int i = 0; i < shards.size(); i++) borrowed.push_back(MyVector<BorrowedBook>());
+    scatter([&](int i) { shards[i]->borrowedBooks(id, borrowed[i]); });
+
+    // the circulation logs of all shards number their records from one
+    // counter, so the first borrows sort into the order of a single catalog
+    MyVector<BorrowedBook> books;
+    for (int i = 0; i < borrowed.size(); i++) {
+        for (int j = 0; j < borrowed[i].size(); j++) books.push_back(borrowed[i][j]);
+    }
+    if (books.size() > 1) stable_sort(&books[0], &books[0] + books.size(), borrowedEarlier);
+
+    ostringstream page;
+    LCMS::printBorrowedBooks(name, id, books, page);
+    output() << page.str() << flush;
+}
+
+void ShardedCatalog::stats(const Command& command) {
+    MyVector<string> outputs;
+    scatterCommand(command, outputs);
+    for (int i = 0; i < outputs.size(); i++) {
+        output() << "shard " << i + 1 << " of " << outputs.size() << ":" << endl << outputs[i];
+    }
+}
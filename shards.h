@@ -0,0 +1,68 @@
+//============================================================================
+// Name         : shards.h
+// Author       :
+// Version      : 1.0
+// Date Created :
+// Date Modified:
+// Description  : Catalog split across several LCMS instances by top-level category
+//============================================================================
+#ifndef _SHARDS_H
+#define _SHARDS_H
+#include<string>
+#include<functional>
+#include "myvector.h"
+#include "lcms.h"
+#include "rwlock.h"
+#include "commands.h"
+using namespace std;
+
+//Every top-level category of the catalog, with everything below it, lives in
+//one of several LCMS instances (shards); a new top-level category goes to the
+//shards in turn. Books stored directly in the root live in shard 0.
+//
+//Commands on a category path run on the shard of its top-level category.
+//Commands on a book title or isbn ask every shard where the book is and run
+//on the shard findBook would have found it in. list, findAll of the root,
+//export, topBooks of the root, overdue, listBooks and stats run on every
+//shard at once and the results are merged in the order a single catalog
+//shows them: top-level categories in the order they were created.
+//
+//The commands that prompt are not available; they take their arguments
+//inline as in executeCommand.
+class ShardedCatalog : public CommandTarget
+{
+	private:
+		MyVector<LCMS*> shards;
+		RWLock placementLock;			//topLevel and owner; exclusive while top-level categories come and go
+		MyVector<string> topLevel;		//top-level categories in creation order
+		MyVector<int> owner;			//shard of each entry of topLevel
+		int nextShard;					//shard that gets the next new top-level category
+
+		ShardedCatalog(const ShardedCatalog&);				//not copyable
+		ShardedCatalog& operator=(const ShardedCatalog&);
+
+		int placed(const string& name);						//index in topLevel, -1 if unknown (caller holds placementLock)
+		int shardOf(const string& path);					//shard of a category path, 0 for unknown ones (caller holds placementLock)
+		int place(const string& name);						//shard of a top-level category, assigned if new (caller holds placementLock exclusively)
+		void unplaceMissing(const string& name);			//forget a top-level category its shard does not have (exclusive)
+		int bookShard(const string& key, bool byIsbn);		//shard holding the book findBook/findIsbn shows, -1 if none (shared)
+		void scatter(const function<void(int)>& work);		//run work(shard) for every shard at once
+		void scatterCommand(const Command& command, MyVector<string>& outputs); //run a command on every shard, collect what each printed
+
+		void import(const string& path);
+		void exportData(const string& parameter);
+		void list(const Command& command);
+		void findAllRoot();
+		SnapshotRef mergedRoot();							//the whole catalog as one snapshot (shared)
+		void topBooksRoot(int count);
+		void overdue(const Command& command);
+		void listBooks(const Command& command);
+		void stats(const Command& command);
+		bool categoryCommand(const Command& command, const string& path);	//addCategory, removeCategory, ...
+
+	public:
+		ShardedCatalog(unsigned int count);
+		~ShardedCatalog();
+		bool execute(const Command& command);
+};
+#endif
@@ -0,0 +1,145 @@
+#include "snapshot.h"
+#include "book.h"
+#include <sstream>
+#include <thread>
+#include <algorithm>
+
+using namespace std;
+
+BookRow::BookRow() : publication_year(0), total_copies(0), available_copies(0), onLoan(0), borrowers(0) {}
+
+BookRow::BookRow(const Book& book)
+    : title(book.title), author(book.author), isbn(book.isbn),
+    publication_year(book.publication_year),
+    total_copies(book.total_copies),
+    available_copies(book.available_copies),
+    onLoan(book.currentBorrowers.size()),
+    borrowers(book.borrowerCount) {}
+
+void BookRow::display(ostream& out) const {
+    out << "----------------------------------------------------\n";
+    out << "Title:               " << title << endl;
+    out << "Author(s):           " << author << endl;
+    out << "ISBN:                " << isbn << endl;
+    out << "Year:                " << publication_year << endl;
+    out << "Total copies:        " << total_copies << endl;
+    out << "Available copies:    " << available_copies - onLoan << endl;
+    out << "----------------------------------------------------\n";
+}
+
+void BookRow::exportRow(ostream& file, const string& category) const {
+    file << "\"" << title << "\","
+        << "\"" << author << "\","
+        << isbn << ","
+        << publication_year << ","
+        << "\"" << category << "\","
+        << total_copies << ","
+        << available_copies << "\n";
+}
+
+// path of a child given the path of its parent
+static string childCategory(const string& category, const string& name) {
+    return category.empty() ? name : category + "/" + name;
+}
+
+void printSnapshot(const NodeSnapshot& node, ostream& out) {
+    out << "Books in category \"" << node.name << "\":" << endl;
+    for (int i = 0; i < node.books.size(); i++) {
+        node.books[i].display(out);
+    }
+
+    for (int i = 0; i < node.children.size(); i++) {
+        printSnapshot(*node.children[i], out);
+    }
+}
+
+// rows of the books stored directly in a node
+static int exportNodeBooks(const NodeSnapshot& node, const string& category, ostream& file) {
+    for (int i = 0; i < node.books.size(); i++) {
+        node.books[i].exportRow(file, category);
+    }
+    return node.books.size();
+}
+
+int exportSnapshot(const NodeSnapshot& node, const string& category, ostream& file) {
+    int count = exportNodeBooks(node, category, file);
+
+    for (int i = 0; i < node.children.size(); i++) {
+        count += exportSnapshot(*node.children[i], childCategory(category, node.children[i]->name), file);
+    }
+
+    return count;
+}
+
+// the nodes of a subtree in pre-order (the order used by exportSnapshot) with their paths
+static void collectPreOrder(const NodeSnapshot& node, const string& category, MyVector<const NodeSnapshot*>& nodes, MyVector<string>& categories) {
+    nodes.push_back(&node);
+    categories.push_back(category);
+    for (int i = 0; i < node.children.size(); i++) {
+        collectPreOrder(*node.children[i], childCategory(category, node.children[i]->name), nodes, categories);
+    }
+}
+
+int exportSnapshotParallel(const NodeSnapshot& node, const string& category, ostream& file, unsigned int threads) {
+    if (threads == 0) threads = thread::hardware_concurrency();
+    if (threads <= 1) return exportSnapshot(node, category, file); // nothing to gain
+
+    MyVector<const NodeSnapshot*> nodes;
+    MyVector<string> categories;
+    collectPreOrder(node, category, nodes, categories);
+
+    // split the pre-order sequence into contiguous ranges of roughly
+    // EXPORT_CHUNK_ROWS books, so that every range can be formatted on its own
+    MyVector<int> bounds; // range i is [bounds[i], bounds[i+1])
+    bounds.push_back(0);
+    int rows = 0;
+    for (int i = 0; i < nodes.size(); ++i) {
+        rows += nodes[i]->books.size();
+        if (rows >= EXPORT_CHUNK_ROWS) {
+            bounds.push_back(i + 1);
+            rows = 0;
+        }
+    }
+    if (bounds.back() != nodes.size()) bounds.push_back(nodes.size());
+
+    int count = 0;
+    int ranges = bounds.size() - 1;
+
+    // format up to `threads` ranges at a time into their own buffers, then
+    // write the buffers out in order; memory stays bounded by one wave
+    for (int first = 0; first < ranges; first += threads) {
+        int wave = min((int)threads, ranges - first);
+        MyVector<string> buffers;
+        MyVector<int> counts;
+        buffers.resize(wave);
+        counts.resize(wave);
+        for (int w = 0; w < wave; ++w) {
+            buffers.push_back("");
+            counts.push_back(0);
+        }
+
+        MyVector<thread*> workers;
+        for (int w = 0; w < wave; ++w) {
+            int from = bounds[first + w];
+            int to = bounds[first + w + 1];
+            string* buffer = &buffers[w];
+            int* rangeCount = &counts[w];
+            workers.push_back(new thread([&nodes, &categories, from, to, buffer, rangeCount]() {
+                ostringstream out;
+                for (int i = from; i < to; ++i) {
+                    *rangeCount += exportNodeBooks(*nodes[i], categories[i], out);
+                }
+                *buffer = out.str();
+            }));
+        }
+
+        for (int w = 0; w < wave; ++w) {
+            workers[w]->join();
+            delete workers[w];
+            file.write(buffers[w].data(), buffers[w].size()); // keep pre-order
+            count += counts[w];
+        }
+    }
+
+    return count;
+}
@@ -0,0 +1,64 @@
+//============================================================================
+// Name         : snapshot.h
+// Author       :
+// Version      : 1.0
+// Date Created :
+// Date Modified:
+// Description  : Immutable point-in-time copies of the catalog
+//============================================================================
+#ifndef _SNAPSHOT_H
+#define _SNAPSHOT_H
+#include<string>
+#include<memory>
+#include<iostream>
+#include "myvector.h"
+using namespace std;
+
+#define EXPORT_CHUNK_ROWS 4096	//rows formatted by one thread before its buffer is written out
+
+class Book;
+
+//what findBook, findAll and export show of a book
+struct BookRow
+{
+	string title;
+	string author;
+	string isbn;
+	int publication_year;
+	int total_copies;
+	int available_copies;		//as exported
+	int onLoan;					//current borrowers
+	int borrowers;				//distinct borrowers the book has had
+
+	BookRow();
+	BookRow(const Book& book);
+	void display(ostream& out) const;								//layout of findBook/findAll
+	void exportRow(ostream& file, const string& category) const;	//one csv line
+};
+
+struct NodeSnapshot;
+typedef shared_ptr<const NodeSnapshot> SnapshotRef;
+
+//Copy of a category subtree as it was at one point in time, built by
+//Tree::snapshot. A snapshot is never changed once built: a node whose subtree
+//has not changed since hands out the same one again, so a new snapshot of the
+//catalog only copies the paths that changed and shares the rest. A snapshot is
+//freed when the last reader and the last newer snapshot drop it.
+struct NodeSnapshot
+{
+	string name;				//name of the category (the path is built while walking down)
+	unsigned long generation;	//generation of the node when it was copied
+	MyVector<BookRow> books;	//books stored directly in the category
+	MyVector<SnapshotRef> children;
+};
+
+//books of a subtree in the layout of Tree::printAll
+void printSnapshot(const NodeSnapshot& node, ostream& out);
+
+//csv rows of every book of a subtree, in pre-order; `category` is the path of
+//the top node ("" for the root). Returns the number of rows.
+int exportSnapshot(const NodeSnapshot& node, const string& category, ostream& file);
+
+//same output as exportSnapshot, rows formatted on several threads (0 = one per core)
+int exportSnapshotParallel(const NodeSnapshot& node, const string& category, ostream& file, unsigned int threads = 0);
+#endif
@@ -0,0 +1,127 @@
+//============================================================================
+// Name         : spscring.h
+// Author       :
+// Version      : 1.0
+// Date Created :
+// Date Modified:
+// Description  : Bounded lock-free queue between one producer and one consumer
+//============================================================================
+#ifndef _SPSCRING_H
+#define _SPSCRING_H
+#include<atomic>
+#include<thread>
+#include<chrono>
+#include<cstddef>
+using namespace std;
+
+#define RING_SPINS 64				//failed attempts before a waiting side starts to sleep
+#define RING_SLEEP_US 50			//sleep of a waiting side between attempts
+
+//Fixed-size ring of slots between exactly one producer thread and one consumer
+//thread. Each index is written by one side only, so push and pop need no lock:
+//the producer publishes a slot by storing tail, the consumer frees it by
+//storing head. T is copied in and out, use pointers for large items.
+//
+//The producer calls close() after its last push; the consumer sees the end of
+//the stream once the ring is empty and closed. Either side can cancel() to make
+//the other one give up instead of waiting forever.
+template <typename T>
+class SpscRing
+{
+	private:
+		T* slots;
+		size_t mask;						//capacity - 1, the capacity is a power of two
+		alignas(64) atomic<size_t> head;	//next slot to pop, written by the consumer
+		alignas(64) atomic<size_t> tail;	//next slot to push, written by the producer
+		atomic<bool> closed;
+		atomic<bool> cancelled;
+
+		SpscRing(const SpscRing&);				//not copyable
+		SpscRing& operator=(const SpscRing&);
+		static void pause(int& attempts);		//back off a little more after every failed attempt
+
+	public:
+		SpscRing(size_t capacity);			//rounded up to a power of two
+		~SpscRing();
+		bool push(const T& item);			//false if the ring is full
+		bool pop(T& item);					//false if the ring is empty
+		bool pushWait(const T& item);		//wait for a free slot, false if the consumer cancelled
+		bool popWait(T& item);				//wait for an item, false at the end of the stream or if cancelled
+		void close();						//producer: no more items
+		void cancel();						//either side: stop waiting
+		bool isCancelled() const;
+};
+
+template <typename T>
+SpscRing<T>::SpscRing(size_t capacity) : head(0), tail(0), closed(false), cancelled(false) {
+	size_t size = 1;
+	while (size < capacity) size *= 2;
+	slots = new T[size];
+	mask = size - 1;
+}
+
+template <typename T>
+SpscRing<T>::~SpscRing() {
+	delete[] slots;
+}
+
+template <typename T>
+bool SpscRing<T>::push(const T& item) {
+	size_t t = tail.load(memory_order_relaxed);
+	if (t - head.load(memory_order_acquire) > mask) return false; // full
+	slots[t & mask] = item;
+	tail.store(t + 1, memory_order_release);
+	return true;
+}
+
+template <typename T>
+bool SpscRing<T>::pop(T& item) {
+	size_t h = head.load(memory_order_relaxed);
+	if (h == tail.load(memory_order_acquire)) return false; // empty
+	item = slots[h & mask];
+	head.store(h + 1, memory_order_release);
+	return true;
+}
+
+template <typename T>
+void SpscRing<T>::pause(int& attempts) {
+	if (++attempts < RING_SPINS) this_thread::yield();
+	else this_thread::sleep_for(chrono::microseconds(RING_SLEEP_US));
+}
+
+template <typename T>
+bool SpscRing<T>::pushWait(const T& item) {
+	int attempts = 0;
+	while (!push(item)) {
+		if (cancelled.load(memory_order_acquire)) return false;
+		pause(attempts);
+	}
+	return true;
+}
+
+template <typename T>
+bool SpscRing<T>::popWait(T& item) {
+	int attempts = 0;
+	while (!pop(item)) {
+		if (cancelled.load(memory_order_acquire)) return false;
+		if (closed.load(memory_order_acquire)) return pop(item); // pushed before close
+		pause(attempts);
+	}
+	return true;
+}
+
+template <typename T>
+void SpscRing<T>::close() {
+	closed.store(true, memory_order_release);
+}
+
+template <typename T>
+void SpscRing<T>::cancel() {
+	cancelled.store(true, memory_order_release);
+}
+
+template <typename T>
+bool SpscRing<T>::isCancelled() const {
+	return cancelled.load(memory_order_acquire);
+}
+#endif
@@ -0,0 +1,74 @@
+// Checkout throughput from 1 to 32 threads. Each thread borrows and returns
+// books of its own (the desks almost never want the same book), so the
+// borrows share catalogLock and only meet on the stripe locks and the short
+// guards. The work is the same BENCH_CHECKOUTS for every thread count: with
+// enough cores the rate should grow with the threads.
+#include "lcms.h"
+#include "output.h"
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <chrono>
+
+using namespace std;
+
+#define BENCH_BOOKS 512			//small, so that the title scan of findBook does not hide the locking
+#define BENCH_CHECKOUTS 64000		//borrow + return pairs per run
+#define BENCH_MAX_THREADS 32
+
+typedef chrono::steady_clock BenchClock;
+
+static string titleOf(int number) {
+    return "Desk book " + to_string(number);
+}
+
+// borrow and return `count` books among those of one desk
+static void desk(LCMS& lcms, int number, int threads, int count) {
+    ostream discard(nullptr);
+    OutputRedirect redirect(discard);
+    string borrower = "desk " + to_string(number);
+    string borrowerId = "d" + to_string(number);
+    int share = BENCH_BOOKS / threads; // books number*share .. (number+1)*share-1 are this desk's
+    for (int i = 0; i < count; i++) {
+        string title = titleOf(number * share + i % share);
+        lcms.borrowBook(title, borrower, borrowerId);
+        lcms.returnBook(title, borrower, borrowerId);
+    }
+}
+
+int main() {
+    LCMS lcms("bench");
+    {
+        ostringstream rows;
+        for (int i = 0; i < BENCH_BOOKS; i++) {
+            rows << titleOf(i) << ",author," << 9790000000000LL + i << ",2000,Desk/Shelf " << i % 32 << ",1,1\n";
+        }
+        istringstream input(rows.str());
+        ostream discard(nullptr);
+        OutputRedirect redirect(discard);
+        lcms.importRows(input);
+    }
+
+    cout << BENCH_CHECKOUTS << " checkouts (borrow + return) per run, " << thread::hardware_concurrency() << " cores" << endl;
+    cout << setw(8) << "threads" << setw(16) << "checkouts/s" << setw(10) << "speedup" << endl;
+    double single = 0;
+    for (int threads = 1; threads <= BENCH_MAX_THREADS; threads *= 2) {
+        MyVector<thread*> desks;
+        BenchClock::time_point start = BenchClock::now();
+        for (int t = 0; t < threads; t++) {
+            desks.push_back(new thread(desk, ref(lcms), t, threads, BENCH_CHECKOUTS / threads));
+        }
+        for (int t = 0; t < desks.size(); t++) {
+            desks[t]->join();
+            delete desks[t];
+        }
+        double seconds = chrono::duration<double>(BenchClock::now() - start).count();
+        double rate = BENCH_CHECKOUTS / seconds;
+        if (threads == 1) single = rate;
+        cout << setw(8) << threads << fixed << setprecision(0) << setw(16) << rate
+            << setprecision(2) << setw(10) << rate / single << endl;
+    }
+    return 0;
+}
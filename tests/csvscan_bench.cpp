@@ -0,0 +1,56 @@
+// Throughput of the CSV field splitter: the scalar reference loop against
+// csvSplitLine with every scanner this cpu supports, on catalog rows shaped
+// like the import's (quoted titles with commas, CRLF endings).
+#include "csvscan.h"
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <chrono>
+
+using namespace std;
+
+#define BENCH_ROWS 200000
+#define BENCH_ROUNDS 5
+
+typedef chrono::steady_clock BenchClock;
+
+// MB/s of a splitter over all rows, best of BENCH_ROUNDS
+static double throughput(const MyVector<string>& rows, size_t bytes, void (*split)(const string&, MyVector<string>&)) {
+    double best = 0;
+    for (int round = 0; round < BENCH_ROUNDS; round++) {
+        size_t fieldCount = 0;
+        BenchClock::time_point start = BenchClock::now();
+        for (int i = 0; i < rows.size(); i++) {
+            MyVector<string> fields;
+            split(rows[i], fields);
+            fieldCount += fields.size();
+        }
+        double seconds = chrono::duration<double>(BenchClock::now() - start).count();
+        if (fieldCount != (size_t)rows.size() * 7) cout << "unexpected field count " << fieldCount << endl;
+        double rate = bytes / seconds / 1e6;
+        if (rate > best) best = rate;
+    }
+    return best;
+}
+
+int main() {
+    MyVector<string> rows;
+    size_t bytes = 0;
+    for (int i = 0; i < BENCH_ROWS; i++) {
+        string row = "\"The Collected Works, Volume " + to_string(i) + "\",\"Author Name " + to_string(i % 977)
+            + ", Jr.\"," + to_string(9780000000000LL + i) + ",1999,Science/Computer Science/Operating Systems,"
+            + to_string(i % 9 + 1) + "," + to_string(i % 9) + "\r";
+        bytes += row.length();
+        rows.push_back(row);
+    }
+
+    cout << rows.size() << " rows, " << bytes / 1024 << " KB" << endl;
+    cout << fixed << setprecision(1);
+    cout << "reference loop: " << throughput(rows, bytes, csvSplitLineScalar) << " MB/s" << endl;
+    const char* scanners[] = { "scalar", "sse2", "avx2" };
+    for (size_t s = 0; s < sizeof(scanners) / sizeof(scanners[0]); s++) {
+        if (!csvUseScanner(scanners[s])) continue;
+        cout << "csvSplitLine (" << csvScannerName() << "): " << throughput(rows, bytes, csvSplitLine) << " MB/s" << endl;
+    }
+    return 0;
+}
@@ -0,0 +1,117 @@
+// Checks the vectorized CSV scanners against the scalar reference splitter:
+// every scanner this cpu supports must split adversarial lines (quotes,
+// embedded commas, CRLF endings, lengths around the 16/32 byte blocks) into
+// exactly the same fields, and find the same newline as memchr.
+#include "csvscan.h"
+#include <iostream>
+#include <string>
+#include <cstring>
+#include <random>
+
+using namespace std;
+
+static const char* SCANNERS[] = { "scalar", "sse2", "avx2" };
+#define RANDOM_LINES 200000
+
+static string describe(const MyVector<string>& fields) {
+    string text;
+    for (int i = 0; i < fields.size(); i++) {
+        text += "[" + fields[i] + "]";
+    }
+    return text;
+}
+
+// false (reported) if csvSplitLine disagrees with csvSplitLineScalar on a line
+static bool sameFields(const string& line, const char* scannerName) {
+    MyVector<string> expected, actual;
+    csvSplitLineScalar(line, expected);
+    csvSplitLine(line, actual);
+    bool same = expected.size() == actual.size();
+    for (int i = 0; same && i < expected.size(); i++) {
+        same = expected[i] == actual[i];
+    }
+    if (!same) {
+        cout << "mismatch (" << scannerName << ") on line: " << line << endl;
+        cout << "  scalar: " << describe(expected) << endl;
+        cout << "  " << scannerName << ": " << describe(actual) << endl;
+    }
+    return same;
+}
+
+// false (reported) if csvFindNewline disagrees with memchr on a buffer
+static bool sameNewline(const string& data, const char* scannerName) {
+    const void* found = memchr(data.data(), '\n', data.length());
+    size_t expected = found ? (const char*)found - data.data() : data.length();
+    size_t actual = csvFindNewline(data.data(), data.length());
+    if (expected != actual) {
+        cout << "newline mismatch (" << scannerName << "): expected " << expected << ", got " << actual
+            << " in a buffer of " << data.length() << " bytes" << endl;
+    }
+    return expected == actual;
+}
+
+int main() {
+    MyVector<string> lines;
+    // hand written cases
+    lines.push_back("");
+    lines.push_back(",");
+    lines.push_back("\"\"");
+    lines.push_back("\",\"");
+    lines.push_back("a,b,c\r");
+    lines.push_back("\"Title, with comma\",Author,9780000001,2001,Fiction/Classics,3,2\r");
+    lines.push_back("\"unterminated, quote,then,commas");
+    lines.push_back("\"\"\"doubled\"\" quotes\",x");
+    lines.push_back(string(31, 'a') + "," + string(32, 'b') + ",\"" + string(15, 'c') + ",\"\r");
+    lines.push_back(string(64, ',') + "\r");
+    lines.push_back(string(33, '"') + "," + string(17, '"'));
+
+    // random lines over the bytes the scanner decides on, with lengths
+    // crossing the block sizes and an optional CRLF ending
+    mt19937 random(27);
+    const char alphabet[] = { '"', ',', 'a', ' ', '\r', 'z', ',', '"' };
+    for (int n = 0; n < RANDOM_LINES; n++) {
+        size_t length = random() % 100;
+        string line;
+        for (size_t i = 0; i < length; i++) {
+            line += alphabet[random() % sizeof(alphabet)];
+        }
+        if (random() % 2) line += '\r';
+        lines.push_back(line);
+    }
+
+    // buffers for the newline finder, with the newline at every position
+    MyVector<string> buffers;
+    for (size_t length = 0; length < 100; length++) {
+        buffers.push_back(string(length, 'x'));
+        for (size_t at = 0; at < length; at++) {
+            string buffer(length, ',');
+            buffer[at] = '\n';
+            if (at + 1 < length) buffer[length - 1] = '\n'; // a later one must not win
+            buffers.push_back(buffer);
+        }
+    }
+
+    int failures = 0;
+    int checked = 0;
+    for (size_t s = 0; s < sizeof(SCANNERS) / sizeof(SCANNERS[0]); s++) {
+        if (!csvUseScanner(SCANNERS[s])) {
+            cout << SCANNERS[s] << ": not supported by this cpu, skipped" << endl;
+            continue;
+        }
+        for (int i = 0; i < lines.size() && failures < 10; i++) {
+            if (!sameFields(lines[i], SCANNERS[s])) failures++;
+        }
+        for (int i = 0; i < buffers.size() && failures < 10; i++) {
+            if (!sameNewline(buffers[i], SCANNERS[s])) failures++;
+        }
+        cout << SCANNERS[s] << ": " << lines.size() << " lines, " << buffers.size() << " buffers checked" << endl;
+        checked++;
+    }
+
+    if (failures > 0) {
+        cout << "csvscan check failed" << endl;
+        return 1;
+    }
+    cout << "csvscan check passed (" << checked << " scanners)" << endl;
+    return 0;
+}
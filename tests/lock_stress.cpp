@@ -0,0 +1,150 @@
+// Mixed workload on one LCMS from STRESS_THREADS threads, built with
+// ThreadSanitizer by `make stress`: queries (find, list, borrower listings,
+// overdue, topBooks, stats, export) run against borrow/return of shared books,
+// which take catalogLock shared plus a stripe lock and the guards, and against
+// commands that take catalogLock exclusively (add, edit, remove, rename,
+// force removal of a category with open loans). TSan reports any data race and
+// makes the run fail; the driver itself checks that the copy counts add up.
+#include "lcms.h"
+#include "output.h"
+#include "csvscan.h"
+#include <iostream>
+#include <sstream>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <atomic>
+#include <random>
+#include <cstdlib>
+
+using namespace std;
+
+#define STRESS_THREADS 8
+#define STRESS_OPERATIONS 1500		//per thread
+#define STRESS_BOOKS 2000
+#define STRESS_CATEGORIES 8
+
+static string titleOf(int number) {
+    return "Stress " + to_string(number);
+}
+
+static string categoryOf(int number) {
+    return "Shared/Part " + to_string(number % STRESS_CATEGORIES);
+}
+
+static void workload(LCMS& lcms, int worker, atomic<long>& operations) {
+    ostream discard(nullptr);
+    OutputRedirect redirect(discard);
+    mt19937 random(1000 + worker);
+    string borrower = "reader " + to_string(worker);
+    string borrowerId = "r" + to_string(worker);
+    string own = "Private " + to_string(worker); // categories only this worker changes
+    int added = 0;
+
+    for (int i = 0; i < STRESS_OPERATIONS; i++) {
+        int book = random() % STRESS_BOOKS;
+        switch (random() % 16) {
+            case 0: lcms.findBook(titleOf(book)); break;
+            case 1: lcms.findIsbn(to_string(9790000000000LL + book)); break;
+            case 2: lcms.findAll(categoryOf(book)); break;
+            case 3: lcms.list(i % 2 ? "--stats" : ""); break;
+            case 4: lcms.listCurrentBorrowers(titleOf(book)); break;
+            case 5: lcms.listAllBorrowers(titleOf(book)); break;
+            case 6: lcms.topBooks("5 Shared"); break;
+            case 7:
+                lcms.overdue("2099-01-01");
+                lcms.stats();
+                break;
+            case 8:
+            case 9:
+                lcms.borrowBook(titleOf(book), borrower, borrowerId);
+                break;
+            case 10:
+            case 11:
+                lcms.returnBook(titleOf(book), borrower, borrowerId);
+                break;
+            case 12: {
+                // a book of our own, borrowed so that removing it closes a loan
+                string title = own + " book " + to_string(added++);
+                lcms.addBook(title, "author", "p" + to_string(worker) + "-" + to_string(added), 2000,
+                    own + "/Shelf", 2, 2);
+                lcms.borrowBook(title, borrower, borrowerId);
+                lcms.editBook(title, 4, to_string(1900 + i % 100));
+                if (added % 3 == 0) lcms.removeBook(title);
+                break;
+            }
+            case 13:
+                lcms.renameCategory(own + "/Shelf", "Shelf2");
+                lcms.renameCategory(own + "/Shelf2", "Shelf");
+                break;
+            case 14:
+                if (i % 5 == 0) lcms.removeCategory("--force " + own); // drops open loans with it
+                else lcms.listBooks(borrower + "," + borrowerId);
+                break;
+            case 15:
+                if (i % 50 == 0) lcms.exportData("/tmp/lcms_stress_" + to_string(worker) + ".csv", i % 100 == 0);
+                else lcms.bookHistory(titleOf(book));
+                break;
+        }
+        operations++;
+    }
+}
+
+int main() {
+    LCMS lcms("stress");
+    {
+        ostringstream rows;
+        for (int i = 0; i < STRESS_BOOKS; i++) {
+            rows << titleOf(i) << ",author " << i % 97 << "," << 9790000000000LL + i << ",2000," << categoryOf(i) << ",3,3\n";
+        }
+        istringstream input(rows.str());
+        if (lcms.importRows(input) != STRESS_BOOKS) {
+            cout << "lock stress: import failed" << endl;
+            return 1;
+        }
+    }
+
+    atomic<long> operations(0);
+    MyVector<thread*> workers;
+    for (int w = 0; w < STRESS_THREADS; w++) {
+        workers.push_back(new thread(workload, ref(lcms), w, ref(operations)));
+    }
+    for (int w = 0; w < workers.size(); w++) {
+        workers[w]->join();
+        delete workers[w];
+    }
+    for (int w = 0; w < STRESS_THREADS; w++) {
+        remove(("/tmp/lcms_stress_" + to_string(w) + ".csv").c_str());
+    }
+
+    // every shared book must still account for its copies: the export has
+    // available copies between 0 and total for every row
+    string path = "/tmp/lcms_stress_final.csv";
+    {
+        ostream discard(nullptr);
+        OutputRedirect redirect(discard);
+        lcms.exportData(path);
+    }
+    ifstream exported(path);
+    string line;
+    getline(exported, line); // header
+    int shared = 0;
+    bool consistent = true;
+    while (getline(exported, line)) {
+        MyVector<string> fields;
+        csvSplitLine(line, fields);
+        if (fields.size() != 7 || fields[0].compare(0, 7, "Stress ") != 0) continue;
+        int total = atoi(fields[5].c_str());
+        int available = atoi(fields[6].c_str());
+        if (total != 3 || available < 0 || available > total) consistent = false;
+        shared++;
+    }
+    remove(path.c_str());
+
+    if (shared != STRESS_BOOKS || !consistent) {
+        cout << "lock stress: inconsistent catalog (" << shared << " shared books)" << endl;
+        return 1;
+    }
+    cout << "lock stress: " << operations << " operations on " << STRESS_THREADS << " threads" << endl;
+    return 0;
+}
@@ -0,0 +1,96 @@
+// Lookup throughput by key length: a scan comparing whole strings against
+// the same scan rejecting on the precomputed hash and length first (KeyHash),
+// and Tree::findBook, which uses the latter, on a catalog of BENCH_BOOKS books
+// whose titles share all but their last characters (the worst case for a
+// string compare).
+#include "tree.h"
+#include "keyhash.h"
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <chrono>
+#include <random>
+
+using namespace std;
+
+#define BENCH_BOOKS 4096
+#define BENCH_PROBES 2000
+#define BENCH_CATEGORIES 16
+
+typedef chrono::steady_clock BenchClock;
+
+static string titleOf(size_t length, int number) {
+    string suffix = to_string(number);
+    return string(length - suffix.length(), 't') + suffix;
+}
+
+static double secondsSince(BenchClock::time_point start) {
+    return chrono::duration<double>(BenchClock::now() - start).count();
+}
+
+int main() {
+    size_t lengths[] = { 8, 32, 128, 512 };
+    mt19937 random(28);
+
+    cout << BENCH_BOOKS << " books, " << BENCH_PROBES << " probes, half of them misses (lookups/s)" << endl;
+    cout << setw(8) << "length" << setw(16) << "string ==" << setw(16) << "hash first" << setw(16) << "findBook" << endl;
+    for (size_t l = 0; l < sizeof(lengths) / sizeof(lengths[0]); l++) {
+        size_t length = lengths[l];
+        Tree tree("lib");
+        MyVector<string> titles;
+        MyVector<KeyHash> keys;
+        for (int i = 0; i < BENCH_BOOKS; i++) {
+            string title = titleOf(length, i);
+            Node* category = tree.createNode("Category " + to_string(i % BENCH_CATEGORIES));
+            tree.addBook(category, new Book(title, "author", to_string(9780000000000LL + i), 2000, 1, 1));
+            titles.push_back(title);
+            keys.push_back(hashKey(title));
+        }
+
+        // even probes hit a random book, odd ones miss and scan everything
+        MyVector<string> probes;
+        MyVector<KeyHash> probeKeys;
+        for (int i = 0; i < BENCH_PROBES; i++) {
+            string probe = titleOf(length, (i % 2 == 0) ? random() % BENCH_BOOKS : BENCH_BOOKS + i);
+            probes.push_back(probe);
+            probeKeys.push_back(hashKey(probe));
+        }
+
+        long found[3] = { 0, 0, 0 };
+        BenchClock::time_point start = BenchClock::now();
+        for (int p = 0; p < probes.size(); p++) {
+            for (int i = 0; i < titles.size(); i++) {
+                if (titles[i] == probes[p]) {
+                    found[0]++;
+                    break;
+                }
+            }
+        }
+        double plain = secondsSince(start);
+
+        start = BenchClock::now();
+        for (int p = 0; p < probes.size(); p++) {
+            for (int i = 0; i < titles.size(); i++) {
+                if (sameKey(titles[i], keys[i], probes[p], probeKeys[p])) {
+                    found[1]++;
+                    break;
+                }
+            }
+        }
+        double hashed = secondsSince(start);
+
+        start = BenchClock::now();
+        for (int p = 0; p < probes.size(); p++) {
+            if (tree.findBook(tree.getRoot(), probes[p], probeKeys[p])) found[2]++;
+        }
+        double inTree = secondsSince(start);
+
+        if (found[0] != BENCH_PROBES / 2 || found[1] != found[0] || found[2] != found[0]) {
+            cout << "unexpected hits: " << found[0] << " " << found[1] << " " << found[2] << endl;
+            return 1;
+        }
+        cout << setw(8) << length << fixed << setprecision(0) << setw(16) << BENCH_PROBES / plain
+            << setw(16) << BENCH_PROBES / hashed << setw(16) << BENCH_PROBES / inTree << endl;
+    }
+    return 0;
+}
@@ -0,0 +1,109 @@
+// Checks that reimport keeps the open loans of a book consistent with its
+// copy counts: a feed row for a book that is on loan does not hand out the
+// copies on loan again (after the return the book has no more copies than it
+// owns), a row with fewer copies than are on loan is refused, and replaying
+// the write-ahead log of all this ends with the same catalog.
+#include "lcms.h"
+#include "output.h"
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <cstdio>
+
+using namespace std;
+
+static const char* LOG_PATH = "/tmp/lcms_reimport_check.wal";
+static const char* FEED_PATH = "/tmp/lcms_reimport_check.csv";
+
+static int failures = 0;
+
+// the row of a book in a copy of the catalog, false if it is not there
+static bool findRow(const NodeSnapshot& node, const string& title, BookRow& row) {
+    for (int i = 0; i < node.books.size(); i++) {
+        if (node.books[i].title == title) {
+            row = node.books[i];
+            return true;
+        }
+    }
+    for (int i = 0; i < node.children.size(); i++) {
+        if (findRow(*node.children[i], title, row)) return true;
+    }
+    return false;
+}
+
+static void expectCopies(LCMS& lcms, const string& step, const string& title, int total, int available) {
+    BookRow row;
+    if (!findRow(*lcms.catalogSnapshot(""), title, row)) {
+        cout << step << ": " << title << " not found" << endl;
+        failures++;
+        return;
+    }
+    if (row.total_copies != total || row.available_copies != available) {
+        cout << step << ": " << title << " has " << row.available_copies << " of " << row.total_copies
+            << " copies available, expected " << available << " of " << total << endl;
+        failures++;
+    }
+}
+
+static void writeFeed(const string& rows) {
+    ofstream feed(FEED_PATH);
+    feed << "Title,Author,ISBN,Publication Year,Category,Total Copies,Available Copies\n" << rows;
+}
+
+int main() {
+    remove(LOG_PATH);
+    ostream discard(nullptr);
+    OutputRedirect quiet(discard);
+    {
+        LCMS lcms("check");
+        lcms.openLog(LOG_PATH, WAL_SYNC_NONE);
+        istringstream rows("Loaned,author,111,2000,Shelf,3,3\nOther,author,222,2001,Shelf,2,2\n");
+        lcms.importRows(rows);
+
+        lcms.borrowBook("Loaned", "ann", "a1");
+        expectCopies(lcms, "borrowed", "Loaned", 3, 2);
+
+        // the vendor lists all three copies as available, one of them is out
+        writeFeed("Loaned,author,111,2001,Shelf,3,3\nOther,author,222,2001,Shelf,2,2\n");
+        lcms.reimport(FEED_PATH);
+        expectCopies(lcms, "reimported while on loan", "Loaned", 3, 2);
+
+        lcms.returnBook("Loaned", "ann", "a1");
+        expectCopies(lcms, "returned", "Loaned", 3, 3);
+
+        // two copies out, the feed lists fewer available than that
+        lcms.borrowBook("Loaned", "ann", "a1");
+        lcms.borrowBook("Loaned", "bob", "b1");
+        writeFeed("Loaned,author,111,2001,Shelf,4,1\nOther,author,222,2001,Shelf,2,2\n");
+        lcms.reimport(FEED_PATH);
+        expectCopies(lcms, "reimported with fewer available", "Loaned", 4, 0);
+        lcms.returnBook("Loaned", "ann", "a1");
+        lcms.returnBook("Loaned", "bob", "b1");
+        expectCopies(lcms, "both returned", "Loaned", 4, 2);
+
+        // a row that cannot hold the open loans is refused
+        lcms.borrowBook("Loaned", "ann", "a1");
+        lcms.borrowBook("Loaned", "bob", "b1");
+        writeFeed("Loaned,author,111,2001,Shelf,1,1\nOther,author,222,2001,Shelf,2,2\n");
+        lcms.reimport(FEED_PATH);
+        expectCopies(lcms, "refused row", "Loaned", 4, 0);
+    }
+    {
+        LCMS replayed("check");
+        replayed.openLog(LOG_PATH, WAL_SYNC_NONE);
+        expectCopies(replayed, "replayed", "Loaned", 4, 0);
+        replayed.returnBook("Loaned", "ann", "a1");
+        replayed.returnBook("Loaned", "bob", "b1");
+        expectCopies(replayed, "returned after replay", "Loaned", 4, 2);
+    }
+    remove(LOG_PATH);
+    remove(FEED_PATH);
+
+    if (failures > 0) {
+        cout << "reimport check failed" << endl;
+        return 1;
+    }
+    cout << "reimport check passed" << endl;
+    return 0;
+}
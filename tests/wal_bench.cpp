@@ -0,0 +1,87 @@
+// Cost of the write-ahead log: checkout throughput (borrow + return pairs,
+// two log records each) without a log and with every sync policy, on one
+// thread and on several. Under "group" the threads waiting for the disk share
+// one fsync, so only that policy should gain from more threads.
+#include "lcms.h"
+#include "output.h"
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <chrono>
+#include <cstdio>
+
+using namespace std;
+
+#define BENCH_BOOKS 512
+#define BENCH_CHECKOUTS 20000		//borrow + return pairs per run
+#define BENCH_THREADS 8
+
+typedef chrono::steady_clock BenchClock;
+
+static const char* LOG_PATH = "/tmp/lcms_wal_bench.log";
+
+static string titleOf(int number) {
+    return "Logged book " + to_string(number);
+}
+
+// borrow and return `count` books among those of one desk
+static void desk(LCMS& lcms, int number, int threads, int count) {
+    ostream discard(nullptr);
+    OutputRedirect redirect(discard);
+    string borrower = "desk " + to_string(number);
+    string borrowerId = "d" + to_string(number);
+    int share = BENCH_BOOKS / threads;
+    for (int i = 0; i < count; i++) {
+        string title = titleOf(number * share + i % share);
+        lcms.borrowBook(title, borrower, borrowerId);
+        lcms.returnBook(title, borrower, borrowerId);
+    }
+}
+
+// checkouts per second on a new catalog, logged with `policy` unless policyName is null
+static double run(const char* policyName, int threads) {
+    LCMS lcms("bench");
+    {
+        ostringstream rows;
+        for (int i = 0; i < BENCH_BOOKS; i++) {
+            rows << titleOf(i) << ",author," << 9790000000000LL + i << ",2000,Desk/Shelf " << i % 32 << ",1,1\n";
+        }
+        istringstream input(rows.str());
+        ostream discard(nullptr);
+        OutputRedirect redirect(discard);
+        lcms.importRows(input); // before the log is opened, it only holds the checkouts
+    }
+    remove(LOG_PATH);
+    WalSync policy;
+    if (policyName && (!WriteAheadLog::parsePolicy(policyName, policy) || lcms.openLog(LOG_PATH, policy) < 0)) {
+        return 0;
+    }
+
+    MyVector<thread*> desks;
+    BenchClock::time_point start = BenchClock::now();
+    for (int t = 0; t < threads; t++) {
+        desks.push_back(new thread(desk, ref(lcms), t, threads, BENCH_CHECKOUTS / threads));
+    }
+    for (int t = 0; t < desks.size(); t++) {
+        desks[t]->join();
+        delete desks[t];
+    }
+    return BENCH_CHECKOUTS / chrono::duration<double>(BenchClock::now() - start).count();
+}
+
+int main() {
+    const char* policies[] = { nullptr, "none", "group", "always" };
+    cout << BENCH_CHECKOUTS << " checkouts (borrow + return) per run, " << thread::hardware_concurrency() << " cores, log in "
+        << LOG_PATH << endl;
+    cout << setw(8) << "sync" << setw(16) << "1 thread/s" << setw(16) << (to_string(BENCH_THREADS) + " threads/s") << endl;
+    for (size_t p = 0; p < sizeof(policies) / sizeof(policies[0]); p++) {
+        double single = run(policies[p], 1);
+        double several = run(policies[p], BENCH_THREADS);
+        cout << setw(8) << (policies[p] ? policies[p] : "no log") << fixed << setprecision(0)
+            << setw(16) << single << setw(16) << several << endl;
+    }
+    remove(LOG_PATH);
+    return 0;
+}
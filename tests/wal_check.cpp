@@ -0,0 +1,154 @@
+// Checks WriteAheadLog::replay: records with escaped fields come back as they
+// were logged, and a torn or corrupt tail (a line without its newline, a line
+// that fails its checksum) is cut off while the records before it are kept,
+// so that the next append continues from the last intact record.
+#include "wal.h"
+#include <iostream>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <cstdio>
+#include <sys/stat.h>
+
+using namespace std;
+
+static const char* LOG_PATH = "/tmp/lcms_wal_check.wal";
+
+static int failures = 0;
+
+static MyVector<string> record(const string& a, const string& b) {
+    MyVector<string> fields;
+    fields.push_back(a);
+    fields.push_back(b);
+    return fields;
+}
+
+// the records every case starts from, with all the characters that need escaping
+static MyVector<MyVector<string> > sample() {
+    MyVector<MyVector<string> > records;
+    records.push_back(record("borrow", "Title\twith a tab"));
+    records.push_back(record("import", "two\nlines\r\n"));
+    records.push_back(record("return", "back\\slash\\"));
+    records.push_back(record("remove", ""));
+    return records;
+}
+
+static void writeLog(const MyVector<MyVector<string> >& records) {
+    remove(LOG_PATH);
+    WriteAheadLog wal;
+    wal.open(LOG_PATH, WAL_SYNC_NONE);
+    for (int i = 0; i < records.size(); i++) wal.waitDurable(wal.append(records[i]));
+    wal.close();
+}
+
+static long long fileSize() {
+    struct stat info;
+    return stat(LOG_PATH, &info) == 0 ? (long long)info.st_size : -1;
+}
+
+static void appendRaw(const string& bytes) {
+    ofstream log(LOG_PATH, ios::binary | ios::app);
+    log << bytes;
+}
+
+static void flipByte(long long offset) {
+    fstream log(LOG_PATH, ios::binary | ios::in | ios::out);
+    log.seekg(offset);
+    char c = log.get();
+    log.seekp(offset);
+    log.put(c ^ 0x20);
+}
+
+// replays the log and compares the records with the first `count` of expected
+static void expectReplay(const string& step, const MyVector<MyVector<string> >& expected, int count) {
+    MyVector<MyVector<string> > replayed;
+    long result = WriteAheadLog::replay(LOG_PATH, [&](const MyVector<string>& fields) { replayed.push_back(fields); });
+    if (result != count || replayed.size() != count) {
+        cout << step << ": replayed " << result << " records, expected " << count << endl;
+        failures++;
+        return;
+    }
+    for (int i = 0; i < count; i++) {
+        bool same = replayed[i].size() == expected[i].size();
+        for (int j = 0; same && j < expected[i].size(); j++) same = replayed[i][j] == expected[i][j];
+        if (!same) {
+            cout << step << ": record " << i << " differs from the one logged" << endl;
+            failures++;
+        }
+    }
+}
+
+static void expectSize(const string& step, long long size) {
+    if (fileSize() != size) {
+        cout << step << ": log has " << fileSize() << " bytes, expected " << size << endl;
+        failures++;
+    }
+}
+
+int main() {
+    // replay prints a warning for every damaged tail, which is what is tested here
+    streambuf* warnings = cerr.rdbuf(nullptr);
+    MyVector<MyVector<string> > records = sample();
+
+    remove(LOG_PATH);
+    expectReplay("missing log", records, 0);
+
+    writeLog(records);
+    long long intact = fileSize();
+    expectReplay("intact log", records, records.size());
+    expectSize("intact log", intact);
+
+    // the last write was cut short: no newline
+    appendRaw("0badf00d\tborrow\tcut sh");
+    expectReplay("torn tail", records, records.size());
+    expectSize("torn tail", intact);
+
+    // appending after the cut continues the log
+    {
+        WriteAheadLog wal;
+        wal.open(LOG_PATH, WAL_SYNC_NONE);
+        wal.waitDurable(wal.append(record("borrow", "after the cut")));
+        wal.close();
+    }
+    records.push_back(record("borrow", "after the cut"));
+    expectReplay("appended after the cut", records, records.size());
+    records = sample();
+
+    // a whole line with a bad checksum, a valid record behind it is not replayed
+    writeLog(records);
+    appendRaw("00000000\tborrow\tgarbage\n");
+    {
+        WriteAheadLog wal;
+        wal.open("/tmp/lcms_wal_check.tail", WAL_SYNC_NONE);
+        wal.waitDurable(wal.append(record("return", "behind the damage")));
+        wal.close();
+        ifstream tail("/tmp/lcms_wal_check.tail", ios::binary);
+        appendRaw(string(istreambuf_iterator<char>(tail), istreambuf_iterator<char>()));
+        remove("/tmp/lcms_wal_check.tail");
+    }
+    expectReplay("corrupt line", records, records.size());
+    expectSize("corrupt line", intact);
+
+    // a damaged byte in the second record keeps only the first
+    writeLog(records);
+    long long first = 0;
+    {
+        ifstream log(LOG_PATH, ios::binary);
+        string line;
+        getline(log, line);
+        first = line.length() + 1;
+    }
+    flipByte(first + 12);
+    expectReplay("damaged middle record", records, 1);
+    expectSize("damaged middle record", first);
+
+    remove(LOG_PATH);
+    cerr.rdbuf(warnings);
+
+    if (failures > 0) {
+        cout << "wal check failed" << endl;
+        return 1;
+    }
+    cout << "wal check passed" << endl;
+    return 0;
+}
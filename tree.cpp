@@ -1,52 +1,132 @@
 #include "tree.h"
+#include "borrower.h"
 #include <iostream>
 #include <fstream>
 #include <string>
 #include <sstream>
+#include <algorithm>
 
 using namespace std;
 
-Node::Node(string name) : name(name), bookCount(0), parent(nullptr) {
-    children = MyVector<Node*>(); // initialize children vector
-    books = MyVector<Book*>(); // initialize books vector
+NodeStats::NodeStats() : titles(0), totalCopies(0), availableCopies(0), loaned(0), borrowerTitles(0) {}
+
+void NodeStats::add(const NodeStats& other, int sign) {
+    titles += sign * other.titles;
+    totalCopies += sign * other.totalCopies;
+    availableCopies += sign * other.availableCopies;
+    loaned += sign * other.loaned;
+    borrowerTitles += sign * other.borrowerTitles;
 }
 
-Node::~Node() {
-    for (int i = 0; i < children.size(); i++) {
-        delete children[i]; // delete each child node to free memory
-    }
+Node::Node() : id(NO_NODE) {
+    reset(""); // arena slots start out as empty nodes
+}
 
-    for (int i = 0; i < books.size(); i++) {
-        delete books[i]; // delete each book to free memory
-    }
+Node::Node(string name) : id(NO_NODE) {
+    reset(name);
+}
+
+void Node::reset(const string& nodeName) {
+    name = nodeName;
+    parent = NO_NODE;
+    firstChild = lastChild = nextSibling = NO_NODE;
+    firstBook = lastBook = NO_BOOK;
+    bookTotal = 0;
+    stats = NodeStats();
+    topCount = 0;
+    generation = 0;
+    snapshot.reset();
 }
 
 void Node::setParent(Node* parentNode) {
-    parent = parentNode; // set the parent node for the current node
+    parent = parentNode ? parentNode->id : NO_NODE; // set the parent node for the current node
 }
 
-string Node::getCategory(Node* node) {
-    if (node->parent == nullptr) {
-        return ""; // return empty string if node has no parent (root node)
-    }
+Tree::Tree(string rootName) : clock(0), nodeSlots(0) {
+    root = allocateNode(rootName); // create the root node with given name
+}
 
-    string categoryPath = node->name; // start building path with nodes name
-    Node* current = node->parent; // initialize current as the parent of the node
+Tree::~Tree() {
+    // books and nodes are owned by the tables, no recursion needed
+    for (int i = 0; i < bookTable.size(); i++) {
+        delete bookTable[i];
+    }
+    for (int i = 0; i < nodeBlocks.size(); i++) {
+        delete[] nodeBlocks[i];
+    }
+}
 
-    while (current != nullptr && current->parent != nullptr) {
-        categoryPath = current->name + "/" + categoryPath; // prepend parents name to path
-        current = current->parent; // move up to the next parent
+Node* Tree::allocateNode(const string& name) {
+    uint32_t id;
+    if (!freeNodes.empty()) {
+        id = freeNodes.back(); // reuse the slot of a dropped node
+        freeNodes.erase(freeNodes.size() - 1);
+    }
+    else {
+        if (nodeSlots % NODE_CHUNK == 0) {
+            nodeBlocks.push_back(new Node[NODE_CHUNK]); // a new block, old blocks never move
+        }
+        id = nodeSlots++;
     }
 
-    return categoryPath; // return the complete path
+    Node* node = nodeAt(id);
+    node->reset(name);
+    node->id = id;
+    return node;
 }
 
-Tree::Tree(string rootName) {
-    root = new Node(rootName); // create the root node with given name
+Node* Tree::nodeAt(uint32_t id) {
+    if (id == NO_NODE) return nullptr;
+    return &nodeBlocks[id / NODE_CHUNK][id % NODE_CHUNK];
 }
 
-Tree::~Tree() {
-    delete root; // delete the root node and whole tree
+Node* Tree::getParent(Node* node) {
+    return node ? nodeAt(node->parent) : nullptr;
+}
+
+Book* Tree::bookAt(uint32_t id) {
+    if (id == NO_BOOK || id >= (uint32_t)bookTable.size()) return nullptr;
+    return bookTable[id];
+}
+
+int Tree::bookSlots() {
+    return bookTable.size();
+}
+
+void Tree::linkChild(Node* parent, Node* child) {
+    child->setParent(parent);
+    child->nextSibling = NO_NODE;
+    if (parent->lastChild == NO_NODE) parent->firstChild = child->id;
+    else nodeAt(parent->lastChild)->nextSibling = child->id;
+    parent->lastChild = child->id;
+}
+
+void Tree::unlinkChild(Node* parent, Node* child) {
+    uint32_t previous = NO_NODE;
+    for (uint32_t c = parent->firstChild; c != NO_NODE; c = nodeAt(c)->nextSibling) {
+        if (c == child->id) {
+            if (previous == NO_NODE) parent->firstChild = child->nextSibling;
+            else nodeAt(previous)->nextSibling = child->nextSibling;
+            if (parent->lastChild == child->id) parent->lastChild = previous;
+            child->nextSibling = NO_NODE;
+            return;
+        }
+        previous = c;
+    }
+}
+
+void Tree::unlinkBook(Node* node, Book* book) {
+    uint32_t previous = NO_BOOK;
+    for (uint32_t b = node->firstBook; b != NO_BOOK; b = bookTable[b]->nextBook) {
+        if (b == book->id) {
+            if (previous == NO_BOOK) node->firstBook = book->nextBook;
+            else bookTable[previous]->nextBook = book->nextBook;
+            if (node->lastBook == book->id) node->lastBook = previous;
+            node->bookTotal--;
+            return;
+        }
+        previous = b;
+    }
 }
 
 Node* Tree::getRoot() {
@@ -54,8 +134,8 @@ Node* Tree::getRoot() {
 }
 
 bool Tree::isLastChild(Node* ptr) {
-    return ptr != root && ptr == ptr->parent->children[ptr->parent->children.size() - 1];
-    // check if node is last child in its parents children vector
+    return ptr != root && ptr->nextSibling == NO_NODE;
+    // check if node is last child in its parents children list
 }
 
 bool Tree::isRoot(Node* node) {
@@ -68,15 +148,8 @@ Node* Tree::getNode(string path) {
     Node* current = root; // start from the root node
 
     while (getline(ss, segment, '/')) { // parse path segments
-        bool found = false; // flag to check if segment found in children
-        for (int i = 0; i < current->children.size(); ++i) {
-            if (current->children[i]->name == segment) { // check if childs name matches segment
-                current = current->children[i]; // move to the matching child node
-                found = true;
-                break;
-            }
-        }
-        if (!found) {
+        current = getChild(current, segment); // move to the matching child node
+        if (current == nullptr) {
             return nullptr; // return null if segment is not found
         }
     }
@@ -96,48 +169,24 @@ Node* Tree::createNode(string path) {
             temp = temp.substr(pos + 1); // update temp to remove processed segment
 
             if (!segment.empty()) { // check if segment is not empty
-                bool found = false; // flag to check if segment is found in children
-                for (int i = 0; i < current->children.size(); i++) {
-                    if (current->children[i] && current->children[i]->name == segment) {
-                        current = current->children[i]; // move to existing child node
-                        found = true;
-                        break;
-                    }
-                }
-
-                if (!found) {
-                    Node* newNode = new Node(segment); // create a new node with the segment name
-                    if (!newNode) {
-                        cout << "Memory allocation failed" << endl;
-                        return nullptr; // return null if memory allocation fails
-                    }
-                    newNode->setParent(current); // set current node as parent
-                    current->children.push_back(newNode); // add new node to children
-                    current = newNode; // move to the new node
+                Node* child = getChild(current, segment); // existing child node
+                if (child == nullptr) {
+                    child = allocateNode(segment); // create a new node with the segment name
+                    linkChild(current, child); // add new node to children
+                    touch(child);
                 }
+                current = child; // move to the child node
             }
         }
 
         if (!temp.empty()) { // if there is a remaining segment in temp
-            bool found = false;
-            for (int i = 0; i < current->children.size(); i++) {
-                if (current->children[i] && current->children[i]->name == temp) {
-                    current = current->children[i]; // move to existing child node
-                    found = true;
-                    break;
-                }
-            }
-
-            if (!found) {
-                Node* newNode = new Node(temp); // create a new node for the remaining segment
-                if (!newNode) {
-                    cout << "Memory allocation failed" << endl;
-                    return nullptr; // return null if memory allocation fails
-                }
-                newNode->setParent(current); // set parent of the new node
-                current->children.push_back(newNode); // add new node to children
-                current = newNode; // move to the new node
+            Node* child = getChild(current, temp);
+            if (child == nullptr) {
+                child = allocateNode(temp); // create a new node for the remaining segment
+                linkChild(current, child); // add new node to children
+                touch(child);
             }
+            current = child; // move to the child node
         }
 
         return current; // return the created or found node
@@ -151,38 +200,127 @@ Node* Tree::createNode(string path) {
 Node* Tree::getChild(Node* ptr, string childname) {
     if (ptr == nullptr) return nullptr; // return null if ptr is null
 
-    for (int i = 0; i < ptr->children.size(); ++i) {
-        if (ptr->children[i]->name == childname) {
-            return ptr->children[i]; // return the child node if name matches
+    for (uint32_t c = ptr->firstChild; c != NO_NODE; c = nodeAt(c)->nextSibling) {
+        if (nodeAt(c)->name == childname) {
+            return nodeAt(c); // return the child node if name matches
         }
     }
 
     return nullptr; // return null if child not found
 }
 
+string Tree::getCategory(Node* node) {
+    if (node->parent == NO_NODE) {
+        return ""; // return empty string if node has no parent (root node)
+    }
+
+    string categoryPath = node->name; // start building path with nodes name
+    Node* current = nodeAt(node->parent); // initialize current as the parent of the node
+
+    while (current != nullptr && current->parent != NO_NODE) {
+        categoryPath = current->name + "/" + categoryPath; // prepend parents name to path
+        current = nodeAt(current->parent); // move up to the next parent
+    }
+
+    return categoryPath; // return the complete path
+}
+
+void Tree::addBook(Node* node, Book* book) {
+    book->id = bookTable.size();
+    bookTable.push_back(book);
+
+    linkBook(node, book);
+    propagate(node, bookStats(book)); // update the category and its parents
+}
+
+void Tree::linkBook(Node* node, Book* book) {
+    // append to the node's chain
+    book->category = node->id;
+    book->nextBook = NO_BOOK;
+    if (node->lastBook == NO_BOOK) node->firstBook = book->id;
+    else bookTable[node->lastBook]->nextBook = book->id;
+    node->lastBook = book->id;
+    node->bookTotal++;
+}
+
+void Tree::moveBook(Book* book, Node* node) {
+    Node* from = nodeAt(book->category);
+    if (from == node) return;
+
+    NodeStats moved = bookStats(book);
+    NodeStats removed = moved;
+    removed.add(moved, -2); // negate
+    unlinkBook(from, book);
+    propagate(from, removed);
+    linkBook(node, book);
+    propagate(node, moved);
+
+    // rankings on the old path drop the book, those on the new path may take it
+    for (Node* ranked = from; ranked != nullptr; ranked = nodeAt(ranked->parent)) {
+        for (uint32_t j = 0; j < ranked->topCount; ++j) {
+            if (ranked->topBooks[j] == book->id) {
+                rebuildTopBooks(ranked);
+                break;
+            }
+        }
+    }
+    if (book->borrowCount > 0) {
+        for (Node* ranked = node; ranked != nullptr; ranked = nodeAt(ranked->parent)) rebuildTopBooks(ranked);
+    }
+}
+
 void Tree::updateBookCount(Node* ptr, int offset) {
     if (ptr == nullptr) return; // do nothing if ptr is null
 
-    ptr->bookCount += offset; // adjust the book count by offset value
+    NodeStats delta;
+    delta.titles = offset;
+    propagate(ptr, delta); // adjust the book count of the node and its ancestors
+}
+
+void Tree::propagate(Node* ptr, const NodeStats& delta) {
+    for (Node* current = ptr; current != nullptr; current = nodeAt(current->parent)) {
+        current->stats.add(delta, +1);
+    }
+    touch(ptr);
+}
 
-    if (ptr->bookCount < 0) {
-        ptr->bookCount = 0; // set to zero if count becomes negative
+void Tree::touch(Node* ptr) {
+    // one fresh value for the whole path, never handed out before, so a
+    // cached result can not match a node that was replaced at the same path
+    unsigned long generation = ++clock;
+    for (Node* current = ptr; current != nullptr; current = nodeAt(current->parent)) {
+        current->generation = generation;
     }
 }
 
+NodeStats Tree::bookStats(Book* book) {
+    NodeStats stats;
+    stats.titles = 1;
+    stats.totalCopies = book->total_copies;
+    stats.availableCopies = book->available_copies;
+    stats.loaned = book->currentBorrowers.size();
+    stats.borrowerTitles = book->borrowerCount;
+    return stats;
+}
+
 Book* Tree::findBook(Node* node, string bookTitle) {
+    return findBook(node, bookTitle, hashKey(bookTitle));
+}
+
+Book* Tree::findBook(Node* node, const string& bookTitle, const KeyHash& titleKey) {
     if (node == nullptr) return nullptr; // return null if node is null
 
     // search for book in the current nodes books
-    for (int i = 0; i < node->books.size(); ++i) {
-        if (node->books[i]->title == bookTitle) {
-            return node->books[i]; // return the book if found
+    for (uint32_t b = node->firstBook; b != NO_BOOK; b = bookTable[b]->nextBook) {
+        Book* book = bookTable[b];
+        if (sameKey(book->title, book->titleKey, bookTitle, titleKey)) {
+            return book; // return the book if found
         }
     }
 
     // if not found, recursively search in children
-    for (int i = 0; i < node->children.size(); ++i) {
-        Book* foundBook = findBook(node->children[i], bookTitle);
+    for (uint32_t c = node->firstChild; c != NO_NODE; c = nodeAt(c)->nextSibling) {
+        Book* foundBook = findBook(nodeAt(c), bookTitle, titleKey);
         if (foundBook != nullptr) {
             return foundBook; // return the book if found in child
         }
@@ -191,30 +329,45 @@ Book* Tree::findBook(Node* node, string bookTitle) {
     return nullptr; // return null if book is not found in the entire subtree
 }
 
+Book* Tree::findBookByIsbn(Node* node, const string& isbn, const KeyHash& isbnKey) {
+    if (node == nullptr) return nullptr;
+
+    for (uint32_t b = node->firstBook; b != NO_BOOK; b = bookTable[b]->nextBook) {
+        Book* book = bookTable[b];
+        if (sameKey(book->isbn, book->isbnKey, isbn, isbnKey)) {
+            return book;
+        }
+    }
+
+    for (uint32_t c = node->firstChild; c != NO_NODE; c = nodeAt(c)->nextSibling) {
+        Book* foundBook = findBookByIsbn(nodeAt(c), isbn, isbnKey);
+        if (foundBook != nullptr) {
+            return foundBook;
+        }
+    }
+
+    return nullptr;
+}
+
 bool Tree::removeBook(Node* node, const string bookTitle) {
+    return removeBook(node, bookTitle, hashKey(bookTitle));
+}
+
+bool Tree::removeBook(Node* node, const string& bookTitle, const KeyHash& titleKey) {
     if (node == nullptr) return false; // return false if node is null
 
     // search for book in the current node
-    for (int i = 0; i < node->books.size(); ++i) {
-        if (node->books[i]->title == bookTitle) {
-            delete node->books[i]; // delete the book object
-            node->books.erase(i); // remove the book from vector
-            node->bookCount--; // decrement the book count
-
-            // propagate book count change to parent nodes
-            Node* current = node->parent;
-            while (current != nullptr) {
-                current->bookCount--;
-                current = current->parent;
-            }
-
+    for (uint32_t b = node->firstBook; b != NO_BOOK; b = bookTable[b]->nextBook) {
+        Book* book = bookTable[b];
+        if (sameKey(book->title, book->titleKey, bookTitle, titleKey)) {
+            deleteBook(book);
             return true; // return true if book removed
         }
     }
 
     // if not found, recursively search in children
-    for (int i = 0; i < node->children.size(); ++i) {
-        if (removeBook(node->children[i], bookTitle)) {
+    for (uint32_t c = node->firstChild; c != NO_NODE; c = nodeAt(c)->nextSibling) {
+        if (removeBook(nodeAt(c), bookTitle, titleKey)) {
             return true; // return true if book was removed from child
         }
     }
@@ -222,61 +375,108 @@ bool Tree::removeBook(Node* node, const string bookTitle) {
     return false; // return false if book not found
 }
 
-void Tree::printAll(Node* node) {
+void Tree::deleteBook(Book* book) {
+    Node* node = nodeAt(book->category);
+    unlinkBook(node, book); // remove the book from the node
+    bookTable[book->id] = nullptr;
+
+    NodeStats removed = bookStats(book);
+    removed.add(removed, -2); // negate
+    propagate(node, removed); // the book leaves the node and its ancestors
+
+    // rankings that listed the book need their next candidate
+    for (Node* ranked = node; ranked != nullptr; ranked = nodeAt(ranked->parent)) {
+        for (uint32_t j = 0; j < ranked->topCount; ++j) {
+            if (ranked->topBooks[j] == book->id) {
+                rebuildTopBooks(ranked);
+                break;
+            }
+        }
+    }
+    delete book; // delete the book object
+}
+
+void Tree::printAll(Node* node, ostream& out) {
     if (node == nullptr) return; // do nothing if node is null
 
-    cout << "Books in category \"" << node->name << "\":" << endl;
-    for (int i = 0; i < node->books.size(); ++i) {
-        node->books[i]->display(); // display each book in the category
+    out << "Books in category \"" << node->name << "\":" << endl;
+    for (uint32_t b = node->firstBook; b != NO_BOOK; b = bookTable[b]->nextBook) {
+        bookTable[b]->display(out); // display each book in the category
     }
 
-    for (int i = 0; i < node->children.size(); ++i) {
-        printAll(node->children[i]); // recursively print books in child categories
+    for (uint32_t c = node->firstChild; c != NO_NODE; c = nodeAt(c)->nextSibling) {
+        printAll(nodeAt(c), out); // recursively print books in child categories
     }
 }
 
-int Tree::exportData(Node* node, ofstream& file) {
+int Tree::exportData(Node* node, ostream& file) {
+    if (node == nullptr) return 0;
+    return exportSnapshot(*snapshot(node), getCategory(node), file);
+}
+
+int Tree::exportDataParallel(Node* node, ostream& file, unsigned int threads) {
     if (node == nullptr) return 0;
+    return exportSnapshotParallel(*snapshot(node), getCategory(node), file, threads);
+}
 
-    int count = 0;
+SnapshotRef Tree::snapshot(Node* node) {
+    // nothing changed below the node since the last copy
+    if (node->snapshot && node->snapshot->generation == node->generation) return node->snapshot;
 
-    for (int i = 0; i < node->books.size(); ++i) {
-        Book* book = node->books[i];
-        file << "\"" << book->title << "\","
-            << "\"" << book->author << "\","
-            << book->isbn << ","
-            << book->publication_year << ","
-            << "\"" << node->getCategory(node) << "\","
-            << book->total_copies << ","
-            << book->available_copies << "\n";
-        ++count;
+    shared_ptr<NodeSnapshot> copy = make_shared<NodeSnapshot>();
+    copy->name = node->name;
+    copy->generation = node->generation;
+    for (uint32_t b = node->firstBook; b != NO_BOOK; b = bookTable[b]->nextBook) {
+        copy->books.push_back(BookRow(*bookTable[b]));
     }
-
-    for (int i = 0; i < node->children.size(); ++i) {
-        count += exportData(node->children[i], file);
+    for (uint32_t c = node->firstChild; c != NO_NODE; c = nodeAt(c)->nextSibling) {
+        copy->children.push_back(snapshot(nodeAt(c))); // unchanged children are shared
     }
 
-    return count; // Remove the cout statement from here
+    node->snapshot = copy;
+    return node->snapshot;
 }
 
 bool Tree::isEmpty() {
     return root == nullptr; // check if tree is empty
 }
 
-void Tree::print() {
-    print_helper("", "", root); // call helper function
+void Tree::print(bool withStats, ostream& out) {
+    if (root == nullptr) return;
+    CategoryListing all;
+    listing(root, all);
+    print(all, withStats, out);
+}
+
+void Tree::print(const CategoryListing& listing, bool withStats, ostream& out) {
+    print_helper("", "", listing, withStats, out); // call helper function
 }
 
-void Tree::print_helper(string padding, string pointer, Node* node) {
-    if (node != nullptr) {
-        cout << padding << pointer << node->name << "(" << node->bookCount << ")" << endl;
+void Tree::print_helper(string padding, string pointer, const CategoryListing& node, bool withStats, ostream& out) {
+    out << padding << pointer << node.name << "(" << node.stats.titles << ")";
+    if (withStats) {
+        out << " [copies: " << node.stats.totalCopies
+            << ", available: " << node.stats.availableCopies
+            << ", on loan: " << node.stats.loaned
+            << ", borrower-titles: " << node.stats.borrowerTitles << "]";
+    }
+    out << endl;
 
-        if (node != root) padding += (isLastChild(node)) ? "   " : "|  ";
+    if (!pointer.empty()) padding += (pointer == "|___") ? "   " : "|  "; // the root adds no indent
 
-        for (int i = 0; i < node->children.size(); i++) {
-            string marker = isLastChild(node->children[i]) ? "|___" : "|---";
-            print_helper(padding, marker, node->children[i]); // recurse on child
-        }
+    for (int c = 0; c < node.children.size(); c++) {
+        string marker = (c == node.children.size() - 1) ? "|___" : "|---";
+        print_helper(padding, marker, *node.children[c], withStats, out); // recurse on child
+    }
+}
+
+void Tree::listing(Node* node, CategoryListing& out) {
+    out.name = node->name;
+    out.stats = node->stats;
+    for (uint32_t c = node->firstChild; c != NO_NODE; c = nodeAt(c)->nextSibling) {
+        shared_ptr<CategoryListing> child = make_shared<CategoryListing>();
+        listing(nodeAt(c), *child);
+        out.children.push_back(child);
     }
 }
 
@@ -286,9 +486,9 @@ void Tree::insert(Node* node, string name) {
         return; // return if node is null
     }
 
-    Node* newNode = new Node(name); // create new node
-    node->children.push_back(newNode); // add to children
-    newNode->setParent(node); // set parent
+    Node* newNode = allocateNode(name); // create new node
+    linkChild(node, newNode); // add to children and set parent
+    touch(newNode);
 
     cout << "Node with name " << name << " inserted as child of " << node->name << "." << endl;
 }
@@ -299,29 +499,112 @@ void Tree::remove(Node* node, string child_name) {
         return; // return if node is null
     }
 
-    bool child_removed = false;
+    Node* child = getChild(node, child_name);
+    if (child == nullptr) {
+        cerr << "Error: Child with name \"" << child_name << "\" not found in node \"" << node->name << "." << endl;
+        return;
+    }
 
-    for (int i = 0; i < node->children.size(); ++i) {
-        if (node->children[i]->name == child_name) {
-            for (int j = 0; j < node->children[i]->children.size(); ++j) {
-                remove(node->children[i], node->children[i]->children[j]->name); // remove descendants
-            }
+    dropSubtree(child); // unlinks, updates counts and frees in one pass
+    cout << "Node with name \"" << child_name << "\" and its children removed from \"" << node->name << "\"." << endl;
+}
+
+int Tree::dropSubtree(Node* node) {
+    if (node == nullptr || node == root) return 0; // the root is never dropped
+
+    // unlink from the parent once
+    Node* parent = nodeAt(node->parent);
+    unlinkChild(parent, node);
+
+    // the subtree's books leave every ancestor at once
+    NodeStats removed = node->stats;
+    removed.add(removed, -2); // negate
+    propagate(parent, removed); // also touches the parent, even for an empty subtree
+    for (Node* current = parent; current != nullptr; current = nodeAt(current->parent)) {
+        rebuildTopBooks(current); // bottom-up, so each rebuild sees fixed children
+    }
+
+    // collect the subtree without recursion
+    MyVector<Node*> nodes;
+    nodes.push_back(node);
+    for (int i = 0; i < nodes.size(); ++i) {
+        for (uint32_t c = nodes[i]->firstChild; c != NO_NODE; c = nodeAt(c)->nextSibling) {
+            nodes.push_back(nodeAt(c));
+        }
+    }
+
+    int dropped = 0;
+    for (int i = 0; i < nodes.size(); ++i) {
+        Node* current = nodes[i];
+        uint32_t b = current->firstBook;
+        while (b != NO_BOOK) {
+            Book* book = bookTable[b];
+            b = book->nextBook;
+            bookTable[book->id] = nullptr; // loans and journal entries are the caller's (see LCMS::removeCategory)
+            delete book;
+            ++dropped;
+        }
 
-            delete node->children[i]; // delete child node
+        current->reset(""); // the slot goes back to the arena
+        freeNodes.push_back(current->id);
+    }
 
-            int index = i; // get index
+    return dropped;
+}
 
-            node->children.erase(index); // remove from children vector
+void Tree::bookBorrowed(Book* book) {
+    book->borrowCount++;
+    for (Node* node = nodeAt(book->category); node != nullptr; node = nodeAt(node->parent)) {
+        rankBook(node, book);
+    }
+}
 
-            child_removed = true;
-            cout << "Node with name \"" << child_name << "\" and its children removed from \"" << node->name << "\"." << endl;
+void Tree::rankBook(Node* node, Book* book) {
+    uint32_t* ranking = node->topBooks;
+
+    int pos = -1; // current place of the book in the ranking
+    for (uint32_t i = 0; i < node->topCount; ++i) {
+        if (ranking[i] == book->id) {
+            pos = i;
             break;
         }
     }
 
+    if (pos == -1) {
+        // counts only grow, so a book outside the ranking enters at the bottom
+        // as soon as it beats the last entry
+        if (node->topCount < TOP_BOOKS) {
+            ranking[node->topCount++] = book->id;
+        }
+        else if (book->borrowCount > bookTable[ranking[TOP_BOOKS - 1]]->borrowCount) {
+            ranking[TOP_BOOKS - 1] = book->id;
+        }
+        else {
+            return;
+        }
+        pos = node->topCount - 1;
+    }
 
-    if (!child_removed) {
-        cerr << "Error: Child with name \"" << child_name << "\" not found in node \"" << node->name << "." << endl;
+    // move up past entries that have been borrowed fewer times
+    while (pos > 0 && bookTable[ranking[pos - 1]]->borrowCount < book->borrowCount) {
+        ranking[pos] = ranking[pos - 1];
+        ranking[pos - 1] = book->id;
+        --pos;
     }
+}
+
+void Tree::rebuildTopBooks(Node* node) {
+    node->topCount = 0;
 
-}
\ No newline at end of file
+    // the subtree's top books are among the node's own books and the top
+    // books of its children
+    for (uint32_t b = node->firstBook; b != NO_BOOK; b = bookTable[b]->nextBook) {
+        if (bookTable[b]->borrowCount > 0) rankBook(node, bookTable[b]);
+    }
+    for (uint32_t c = node->firstChild; c != NO_NODE; c = nodeAt(c)->nextSibling) {
+        Node* child = nodeAt(c);
+        for (uint32_t j = 0; j < child->topCount; ++j) {
+            rankBook(node, bookTable[child->topBooks[j]]);
+        }
+    }
+}
@@ -9,32 +9,69 @@
 #ifndef _TREE_H
 #define _TREE_H
 #include<string>
+#include<stdint.h>
 #include "myvector.h"
 #include "book.h"
+#include "snapshot.h"
 using namespace std;
+
+#define TOP_BOOKS 10			//number of most borrowed books ranked in every category
+#define NODE_CHUNK 256			//nodes per block of the node arena
+#define NO_NODE 0xFFFFFFFFu		//null node id
+#define NO_BOOK 0xFFFFFFFFu		//null book id
+
+//aggregates of a category subtree, kept up to date by Tree::propagate
+struct NodeStats
+{
+	long titles;				//books in the subtree
+	long totalCopies;			//sum of total_copies
+	long availableCopies;		//sum of available_copies
+	long loaned;				//copies currently on loan
+	long borrowerTitles;		//(borrower, book) pairs: sum over books of the distinct borrowers each book has had
+
+	NodeStats();
+	void add(const NodeStats& other, int sign);	//this += sign * other
+};
+
+//the categories of a subtree with their aggregates, as the list command shows them
+struct CategoryListing
+{
+	string name;
+	NodeStats stats;
+	MyVector<shared_ptr<CategoryListing> > children;
+};
+//==========================================================
+//Nodes live in blocks of NODE_CHUNK owned by the Tree and refer to each other
+//and to their books (the chain and the ranking) by 32-bit ids, as books refer
+//to their node; ids are resolved with Tree::nodeAt and Tree::bookAt. Children form a singly linked list (firstChild/nextSibling) and
+//the books of a node are chained through Book::nextBook.
 class Node
 {
 	private:
 		string name;				//name of the Node
-		MyVector<Node*> children;	//Children of Node
-		MyVector<Book*> books;		//Books in every Node
-		unsigned int bookCount;
-		Node* parent; 				//link to the parent 
+		uint32_t id;				//position in the node arena
+		uint32_t parent; 			//link to the parent (NO_NODE for the root)
+		uint32_t firstChild;		//first child or NO_NODE
+		uint32_t lastChild;			//last child or NO_NODE, for O(1) appends
+		uint32_t nextSibling;		//next child of the parent or NO_NODE
+		uint32_t firstBook;			//first book of the node or NO_BOOK
+		uint32_t lastBook;			//last book of the node or NO_BOOK
+		uint32_t bookTotal;			//books stored directly in the node
+		NodeStats stats;			//aggregates of the whole subtree (stats.titles is the book count)
+		uint32_t topBooks[TOP_BOOKS];	//ids of the most borrowed books of the subtree, most borrowed first
+		uint32_t topCount;			//entries of topBooks in use
+		unsigned long generation;	//changes whenever anything in the subtree changes (see Tree::touch)
+		SnapshotRef snapshot;		//last copy of the subtree, reused while generation is unchanged
+
+		void reset(const string& name);	//make a recycled slot an empty node
 
 	public:
 		//constructor to create an empty node (category/sub-category)
+		Node();
 		Node(string name);
 
 		void setParent(Node* parentNode); // parent setter
 
-		// return category of a node (e.g. "Computer Science/Operating Systems")
-		// where "Operating Systems" is the name of node and "Computer Science"
-		// is the name of the name of the parent node.
-		string getCategory(Node* node);
-		
-		//deletes a node and clear/clean all its vectors
-		~Node();	
-
 	public:
 		friend class Tree;
 		friend class LCMS;
@@ -44,26 +81,62 @@ class Tree
 {
 	private:
 		Node *root;				//root of the Tree
-		
+		unsigned long clock;	//last generation handed out by touch()
+		MyVector<Node*> nodeBlocks;	//the node arena, blocks of NODE_CHUNK nodes that never move
+		uint32_t nodeSlots;		//node ids handed out so far
+		MyVector<uint32_t> freeNodes;	//ids of dropped nodes, reused first
+		MyVector<Book*> bookTable;	//every book by id, nullptr once removed
+
+		Node* allocateNode(const string& name);			//take a node from the arena
+		void linkChild(Node* parent, Node* child);		//append a child to a node
+		void unlinkChild(Node* parent, Node* child);	//remove a child from a node's list
+		void unlinkBook(Node* node, Book* book);		//remove a book from a node's chain
+		void linkBook(Node* node, Book* book);			//append a book to a node's chain
+		void rankBook(Node *node, Book* book);			//move a book whose borrowCount grew to its place in a node's topBooks
+		void rebuildTopBooks(Node *node);				//recompute a node's topBooks from its books and its children's topBooks
+
 	public:	 	//Required methods
 		Tree(string rootName);	
 		~Tree();
 		Node* getRoot();
+		Node* nodeAt(uint32_t id);						//node with a given id, nullptr for NO_NODE
+		Node* getParent(Node* node);					//parent of a node, nullptr for the root
+		Book* bookAt(uint32_t id);						//book with a given id, nullptr if it was removed
+		int bookSlots();								//book ids handed out so far (use with bookAt)
 		bool isLastChild(Node *ptr);	//given a pointer to node, the method should determine that the node is the last child in the children vector or not
 		void insert(Node* node,string name);			//insert a new child to a given node of of the tree
 		void remove(Node* node,string child_name);		//remove a specific child from a given node of the tree
+		int dropSubtree(Node* node);					//unlink a node with its whole subtree, fix ancestor counts once and free it, returns the number of books dropped
 		bool isRoot(Node* node); 						//return true if the given node is the root, false otherwise
 		Node* getNode(string path);						//given a path (category/sub-category/sub-category/..) the method should return the Node if found, false otherwise
 		Node* createNode(string path);					//Create a node on a given path, e.g. category/sub-category/sub-category/...
 		Node* getChild(Node *ptr, string childname);	//given a node and	name of a child, the method returns pointer to the child node if exist, nullptr otherwise
+		// return category of a node (e.g. "Computer Science/Operating Systems")
+		// where "Operating Systems" is the name of node and "Computer Science"
+		// is the name of the name of the parent node.
+		string getCategory(Node* node);
+		void addBook(Node* node, Book* book);			//add a new book to a node, give it an id and update the aggregates
 		void updateBookCount(Node *ptr, int offset);	//update a books count by an offset e.g. +1/-1
+		void propagate(Node *ptr, const NodeStats& delta); //add delta to the aggregates of a node and all its ancestors (and touch them)
+		void touch(Node *ptr);							//give a node and all its ancestors a new generation, call after any change in the subtree
+		static NodeStats bookStats(Book* book);			//what a single book contributes to the aggregates
 		Book* findBook(Node *node, string bookTitle);	//find a book in a given node, returns nullptr the book is not found
+		Book* findBook(Node *node, const string& bookTitle, const KeyHash& titleKey); //same, with the hash of the title computed once by the caller
+		Book* findBookByIsbn(Node *node, const string& isbn, const KeyHash& isbnKey); //find a book by isbn in a given node and its children
 		bool removeBook(Node* node,string bookTitle);   //remove a book from a given node
-		void printAll(Node *node);					    //printAll books of a node and it children recursively (see output of findAll command)
-		void print();			                        //Print all categories/sub-categories of a the tree. see output of list command (please use the implementation given below)
-		void print_helper(string padding, string pointer,Node *node); // helper method for the print() (please use the implementation given below)
-		int exportData(Node *node,ofstream& file);		//Export all books of a given node and its children to a specific file.
+		bool removeBook(Node* node,const string& bookTitle,const KeyHash& titleKey); //same, with the hash of the title computed once by the caller
+		void deleteBook(Book* book);					//remove a given book from its category, update the aggregates and rankings and free it
+		void moveBook(Book* book, Node* node);			//move a book to another category, keeping its id, and update the aggregates and rankings
+		void printAll(Node *node, ostream& out=cout);	//printAll books of a node and it children recursively (see output of findAll command)
+		void print(bool withStats=false, ostream& out=cout); //Print all categories/sub-categories of a the tree. see output of list command (please use the implementation given below)
+		static void print(const CategoryListing& listing, bool withStats=false, ostream& out=cout); //same, for a listing (a catalog split across trees is merged into one first)
+		static void print_helper(string padding, string pointer,const CategoryListing& node,bool withStats=false, ostream& out=cout); // helper method for the print() (please use the implementation given below)
+		void listing(Node *node, CategoryListing& out);	//names and aggregates of the categories of a subtree
+		int exportData(Node *node,ostream& file);		//Export all books of a given node and its children to a specific file.
+		int exportDataParallel(Node *node,ostream& file,unsigned int threads=0); //same output as exportData, rows formatted on several threads (0 = one per core)
+		SnapshotRef snapshot(Node *node);				//point-in-time copy of a subtree, sharing the parts that did not change since the last one (the caller must keep the tree from changing meanwhile)
 		bool isEmpty();									//return true if the tree is empty false otherwise
+		void bookBorrowed(Book* book);					//count a checkout and update the rankings of the book's category and its ancestors
 
 
 
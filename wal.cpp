@@ -0,0 +1,225 @@
+#include "wal.h"
+#include <iostream>
+#include <fstream>
+#include <cstring>
+#include <cerrno>
+#include <cstdio>
+#include <unistd.h>
+#include <fcntl.h>
+
+using namespace std;
+
+// FNV-1a, stable across builds so old logs stay readable
+static uint32_t checksum(const char* data, size_t len) {
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < len; i++) {
+        hash ^= (unsigned char)data[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+static void escapeField(const string& field, string& out) {
+    for (size_t i = 0; i < field.length(); i++) {
+        switch (field[i]) {
+        case '\\': out += "\\\\"; break;
+        case '\t': out += "\\t"; break;
+        case '\n': out += "\\n"; break;
+        case '\r': out += "\\r"; break;
+        default: out += field[i];
+        }
+    }
+}
+
+// split an unescaped-tab separated payload back into fields, false if an escape is malformed
+static bool splitFields(const string& payload, MyVector<string>& fields) {
+    string field;
+    for (size_t i = 0; i < payload.length(); i++) {
+        char c = payload[i];
+        if (c == '\t') {
+            fields.push_back(field);
+            field.clear();
+        }
+        else if (c == '\\') {
+            if (++i == payload.length()) return false;
+            switch (payload[i]) {
+            case '\\': field += '\\'; break;
+            case 't': field += '\t'; break;
+            case 'n': field += '\n'; break;
+            case 'r': field += '\r'; break;
+            default: return false;
+            }
+        }
+        else {
+            field += c;
+        }
+    }
+    fields.push_back(field);
+    return true;
+}
+
+WriteAheadLog::WriteAheadLog()
+    : fd(-1), policy(WAL_SYNC_GROUP), appended(0), durable(0), flushing(false), failed(false), syncs(0) {}
+
+WriteAheadLog::~WriteAheadLog() {
+    close();
+}
+
+bool WriteAheadLog::open(const string& path, WalSync syncPolicy) {
+    close();
+    fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        cerr << "error: unable to open write-ahead log " << path << ": " << strerror(errno) << endl;
+        return false;
+    }
+    policy = syncPolicy;
+    appended = durable = syncs = 0;
+    failed = false;
+    return true;
+}
+
+void WriteAheadLog::close() {
+    if (fd < 0) return;
+    waitDurable(appended); // nothing buffered is left behind
+    if (policy == WAL_SYNC_NONE) fdatasync(fd);
+    ::close(fd);
+    fd = -1;
+}
+
+bool WriteAheadLog::writeOut(const string& data, bool sync) {
+    size_t done = 0;
+    while (done < data.length()) {
+        ssize_t written = write(fd, data.data() + done, data.length() - done);
+        if (written < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+        done += written;
+    }
+    bool ok = done == data.length();
+    if (ok && sync) {
+        ok = fdatasync(fd) == 0;
+        syncs++;
+    }
+    if (!ok && !failed) {
+        failed = true;
+        cerr << "error: write-ahead log write failed: " << strerror(errno) << endl;
+    }
+    return ok;
+}
+
+unsigned long WriteAheadLog::append(const MyVector<string>& fields) {
+    string payload;
+    for (int i = 0; i < fields.size(); i++) {
+        if (i > 0) payload += '\t';
+        escapeField(fields[i], payload);
+    }
+    char head[10];
+    snprintf(head, sizeof(head), "%08x\t", checksum(payload.data(), payload.length()));
+    string line = head + payload + "\n";
+
+    lock_guard<mutex> lock(guard);
+    unsigned long sequence = ++appended;
+    if (fd < 0) return sequence;
+    if (policy == WAL_SYNC_GROUP) {
+        buffer += line; // written by the next waitDurable
+        return sequence;
+    }
+    writeOut(line, policy == WAL_SYNC_ALWAYS);
+    durable = sequence;
+    return sequence;
+}
+
+void WriteAheadLog::waitDurable(unsigned long sequence) {
+    unique_lock<mutex> lock(guard);
+    while (durable < sequence) {
+        if (flushing) {
+            synced.wait(lock); // someone else is syncing, maybe our record too
+            continue;
+        }
+
+        // write everything appended so far with one fsync, without blocking appends
+        flushing = true;
+        string batch;
+        batch.swap(buffer);
+        unsigned long upTo = appended;
+        lock.unlock();
+        if (fd >= 0) writeOut(batch, true);
+        lock.lock();
+        durable = upTo;
+        flushing = false;
+        synced.notify_all();
+    }
+}
+
+unsigned long WriteAheadLog::recordCount() {
+    lock_guard<mutex> lock(guard);
+    return appended;
+}
+
+unsigned long WriteAheadLog::syncCount() {
+    return syncs;
+}
+
+WalSync WriteAheadLog::syncPolicy() {
+    return policy;
+}
+
+bool WriteAheadLog::parsePolicy(const string& name, WalSync& syncPolicy) {
+    if (name == "always") syncPolicy = WAL_SYNC_ALWAYS;
+    else if (name == "group") syncPolicy = WAL_SYNC_GROUP;
+    else if (name == "none") syncPolicy = WAL_SYNC_NONE;
+    else return false;
+    return true;
+}
+
+const char* WriteAheadLog::policyName(WalSync syncPolicy) {
+    switch (syncPolicy) {
+    case WAL_SYNC_ALWAYS: return "always";
+    case WAL_SYNC_NONE: return "none";
+    default: return "group";
+    }
+}
+
+bool WriteAheadLog::decodeRecord(const string& line, MyVector<string>& fields) {
+    unsigned int expected = 0;
+    return line.length() >= 9 && line[8] == '\t' && sscanf(line.c_str(), "%8x", &expected) == 1
+        && expected == checksum(line.data() + 9, line.length() - 9) && splitFields(line.substr(9), fields);
+}
+
+long WriteAheadLog::replay(const string& path, const function<void(const MyVector<string>&)>& apply) {
+    ifstream file(path, ios::binary);
+    if (!file.is_open()) {
+        return access(path.c_str(), F_OK) == 0 ? -1 : 0; // no log yet
+    }
+
+    long count = 0;
+    long long intact = 0; // bytes of whole, valid records
+    string line;
+    bool torn = false;
+    while (getline(file, line)) {
+        if (file.eof()) {
+            torn = true; // no newline: the write was cut short
+            break;
+        }
+        MyVector<string> fields;
+        if (!decodeRecord(line, fields)) {
+            torn = true;
+            break;
+        }
+        apply(fields);
+        intact += line.length() + 1;
+        count++;
+    }
+    file.close();
+
+    if (torn) {
+        cerr << "warning: write-ahead log " << path << " ends in a damaged record, " << count
+            << " records kept" << endl;
+        if (truncate(path.c_str(), intact) != 0) {
+            cerr << "error: unable to cut off the damaged record: " << strerror(errno) << endl;
+            return -1;
+        }
+    }
+    return count;
+}
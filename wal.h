@@ -0,0 +1,86 @@
+//============================================================================
+// Name         : wal.h
+// Author       :
+// Version      : 1.0
+// Date Created :
+// Date Modified:
+// Description  : Write-ahead log of catalog changes
+//============================================================================
+#ifndef _WAL_H
+#define _WAL_H
+#include<string>
+#include<mutex>
+#include<condition_variable>
+#include<functional>
+#include<atomic>
+#include "myvector.h"
+using namespace std;
+
+//when a logged change is on disk
+enum WalSync
+{
+	WAL_SYNC_ALWAYS,	//every record is written and fsync'd on its own
+	WAL_SYNC_GROUP,		//records are buffered, one fsync covers every change waiting for it
+	WAL_SYNC_NONE		//every record is written, fsync is left to the operating system
+};
+
+//One record per line: an 8 digit hex checksum, then the fields separated by
+//tabs, with '\', tab, CR and LF escaped. A record that was only partly written
+//when the process died fails its checksum; replay stops there and cuts it off.
+//
+//append() may be called by many threads at once; the order of the records is
+//the order of the calls. A change is durable once waitDurable() returned for
+//its sequence number. Under WAL_SYNC_GROUP the first waiter writes and syncs
+//everything appended so far while the others wait for it, so concurrent
+//changes share one fsync.
+class WriteAheadLog
+{
+	private:
+		int fd;						//log file, -1 if closed
+		WalSync policy;
+		mutex guard;				//buffer and counters
+		condition_variable synced;	//durable moved on
+		string buffer;				//records appended but not yet written (WAL_SYNC_GROUP)
+		unsigned long appended;		//sequence number of the last record appended
+		unsigned long durable;		//records up to this one are on disk
+		bool flushing;				//a waiter is writing the buffer right now
+		bool failed;				//a write or sync failed, reported once
+		atomic<unsigned long> syncs;	//fsync calls made (counted outside guard by the flushing waiter)
+
+		WriteAheadLog(const WriteAheadLog&);			//not copyable
+		WriteAheadLog& operator=(const WriteAheadLog&);
+		bool writeOut(const string& data, bool sync);	//write (and sync) data, reports failures
+
+	public:
+		WriteAheadLog();
+		~WriteAheadLog();
+		bool open(const string& path, WalSync policy);	//open for appending, creating the file if needed
+		void close();
+		unsigned long append(const MyVector<string>& fields);	//log a record, returns its sequence number
+		void waitDurable(unsigned long sequence);		//return once the record is on disk (as far as the policy goes)
+		unsigned long recordCount();					//records appended since open
+		unsigned long syncCount();						//fsync calls since open
+		WalSync syncPolicy();
+
+		static bool parsePolicy(const string& name, WalSync& policy);	//"always", "group" or "none"
+		static const char* policyName(WalSync policy);
+		static bool decodeRecord(const string& line, MyVector<string>& fields);	//fields of one record line (without its newline), false if it is damaged
+		//call apply for every intact record of a log in order and cut off a torn
+		//tail, returns the number of records or -1 if the file can not be read
+		//(a missing file is an empty log)
+		static long replay(const string& path, const function<void(const MyVector<string>&)>& apply);
+};
+
+//waits for a logged change when it goes out of scope; declared before the
+//locks of a change, so that the wait happens after they are released
+class DurableChange
+{
+	private:
+		WriteAheadLog* log;
+		unsigned long sequence;
+	public:
+		DurableChange(WriteAheadLog* log) : log(log), sequence(0) {}
+		~DurableChange() { if (log && sequence) log->waitDurable(sequence); }
+		void record(const MyVector<string>& fields) { if (log) sequence = log->append(fields); }	//no-op without a log
+};
+#endif